@@ -0,0 +1,92 @@
+#pragma once
+#include <cmath>
+#include <algorithm>
+
+// Loudness matched output for fair A/B. Input and output power are measured once per
+// block and followed with slow running averages. The difference is a dB correction
+// that the processor adds to the OUTPUT target, so it rides the existing output smoother.
+// The correction it hands out only moves in steps above hysteresisDB: the running average
+// changes a little every block, and retargeting the smoother that often would keep it
+// ramping (and converting dB per sample) forever. No lookahead and no latency.
+class AutoGain
+{
+public:
+    static constexpr float timeConstant = 0.4f;
+    static constexpr float maxCorrectionDB = 24.0f;
+    static constexpr float hysteresisDB = 0.1f;
+
+    void prepare (double newSampleRate)
+    {
+        sampleRate = (float) newSampleRate;
+        reset();
+    }
+
+    void reset()
+    {
+        inputPower = 0.0f;
+        outputPower = 0.0f;
+        correctionDB = 0.0f;
+        appliedCorrectionDB = 0.0f;
+    }
+
+    // call before processing, with the untouched input
+    void measureInput (const float* const* channels, int numChannels, int numSamples)
+    {
+        inputPower = follow (inputPower, meanSquare (channels, numChannels, numSamples), numSamples);
+    }
+
+    // call after processing; appliedGainPower is the mean square of the linear output gain
+    // over the block. It is divided out so the correction does not chase itself, and taking
+    // the whole ramp keeps a block where OUTPUT is still gliding from being misjudged.
+    void measureOutput (const float* const* channels, int numChannels, int numSamples, float appliedGainPower)
+    {
+        if (appliedGainPower <= 0.0f)
+            return;
+
+        outputPower = follow (outputPower, meanSquare (channels, numChannels, numSamples) / appliedGainPower, numSamples);
+
+        // hold the last correction through silence
+        if (inputPower > silence && outputPower > silence)
+            correctionDB = std::min (maxCorrectionDB, std::max (-maxCorrectionDB, 10.0f * std::log10 (inputPower / outputPower)));
+
+        if (std::abs (correctionDB - appliedCorrectionDB) > hysteresisDB)
+            appliedCorrectionDB = correctionDB;
+    }
+
+    float getCorrectionDB() const { return appliedCorrectionDB; }
+
+    // block reduction, four partial sums so the compiler can keep it in vector registers
+    static float meanSquare (const float* const* channels, int numChannels, int numSamples)
+    {
+        if (numChannels <= 0 || numSamples <= 0)
+            return 0.0f;
+
+        float sum[4] = {};
+        for (int channel = 0; channel < numChannels; ++channel)
+        {
+            const auto* data = channels[channel];
+            int i = 0;
+            for (; i + 4 <= numSamples; i += 4)
+                for (int k = 0; k < 4; ++k)
+                    sum[k] += data[i + k] * data[i + k];
+            for (; i < numSamples; ++i)
+                sum[0] += data[i] * data[i];
+        }
+        return (sum[0] + sum[1] + sum[2] + sum[3]) / (float) (numChannels * numSamples);
+    }
+
+private:
+    static constexpr float silence = 1.0e-8f;
+
+    float follow (float average, float blockPower, int numSamples) const
+    {
+        const auto coeff = std::exp (-(float) numSamples / (timeConstant * sampleRate));
+        return blockPower + coeff * (average - blockPower);
+    }
+
+    float sampleRate = 44100.0f;
+    float inputPower = 0.0f;
+    float outputPower = 0.0f;
+    float correctionDB = 0.0f;
+    float appliedCorrectionDB = 0.0f;
+};
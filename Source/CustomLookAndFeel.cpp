@@ -12,7 +12,11 @@
 
 CustomDial::CustomDial()
 {
-    
+    // one look and feel is shared by every knob, so the shadow is only configured here
+    shadowProperties.radius = 24;
+    shadowProperties.offset = juce::Point<int>(-1,4);
+    shadowProperties.colour = juce::Colours::black.withAlpha(0.8f);
+    dialShadow.setShadowProperties(shadowProperties);
 }
 
 void CustomDial::drawRotarySlider(juce::Graphics& g, int x, int y, int width, int height, float sliderPos,
@@ -38,10 +42,6 @@ void CustomDial::drawRotarySlider(juce::Graphics& g, int x, int y, int width, in
     dialTick.addRectangle(0, -radius + 6, 2.0f, radius * 0.3);
     g.fillPath(dialTick, juce::AffineTransform::rotation(angle).translated(centerX, centerY));
     
-    shadowProperties.radius = 24;
-    shadowProperties.offset = juce::Point<int>(-1,4);
-    shadowProperties.colour = juce::Colours::black.withAlpha(0.8f);
-    dialShadow.setShadowProperties(shadowProperties);
     slider.setComponentEffect(&dialShadow);
 }
 
@@ -0,0 +1,199 @@
+#pragma once
+#include <JuceHeader.h>
+#include <array>
+#include <atomic>
+#include <cmath>
+
+//Lock free single producer/single consumer ring of L/R sample pairs for the goniometer.
+//Both channels share one AbstractFifo so a pair can never be split.
+template <typename SampleType>
+class StereoBufferQueue
+{
+public:
+    // the editor drains it at 30 Hz, 6400 pairs at 192 kHz
+    static constexpr size_t fifoSize = 1U << 13;
+
+    //samples that don't fit are dropped
+    void push(const SampleType* left, const SampleType* right, size_t numSamples)
+    {
+        int start1, size1, start2, size2;
+        abstractFifo.prepareToWrite((int)numSamples, start1, size1, start2, size2);
+
+        if (size1 > 0)
+        {
+            juce::FloatVectorOperations::copy(leftBuffer.data() + start1, left, size1);
+            juce::FloatVectorOperations::copy(rightBuffer.data() + start1, right, size1);
+        }
+        if (size2 > 0)
+        {
+            juce::FloatVectorOperations::copy(leftBuffer.data() + start2, left + size1, size2);
+            juce::FloatVectorOperations::copy(rightBuffer.data() + start2, right + size1, size2);
+        }
+
+        abstractFifo.finishedWrite(size1 + size2);
+    }
+
+    // returns the number of pairs copied
+    size_t pop(SampleType* left, SampleType* right, size_t maxSamples)
+    {
+        int start1, size1, start2, size2;
+        abstractFifo.prepareToRead((int)maxSamples, start1, size1, start2, size2);
+
+        if (size1 > 0)
+        {
+            juce::FloatVectorOperations::copy(left, leftBuffer.data() + start1, size1);
+            juce::FloatVectorOperations::copy(right, rightBuffer.data() + start1, size1);
+        }
+        if (size2 > 0)
+        {
+            juce::FloatVectorOperations::copy(left + size1, leftBuffer.data() + start2, size2);
+            juce::FloatVectorOperations::copy(right + size1, rightBuffer.data() + start2, size2);
+        }
+
+        abstractFifo.finishedRead(size1 + size2);
+        return (size_t)(size1 + size2);
+    }
+
+private:
+    std::array<SampleType, fifoSize> leftBuffer;
+    std::array<SampleType, fifoSize> rightBuffer;
+    juce::AbstractFifo abstractFifo{ (int)fifoSize };
+};
+
+//==============================================================================
+// Audio thread side: phase correlation of one block, published through an atomic.
+// +1 is mono, 0 uncorrelated, -1 out of phase. Silence reads as 0.
+template <typename SampleType>
+class CorrelationMeter
+{
+public:
+    void process(const SampleType* left, const SampleType* right, size_t numSamples)
+    {
+        SampleType lr = 0, ll = 0, rr = 0;
+        for (size_t i = 0; i < numSamples; ++i)
+        {
+            lr += left[i] * right[i];
+            ll += left[i] * left[i];
+            rr += right[i] * right[i];
+        }
+
+        const auto energy = ll * rr;
+        correlation.store(energy > SampleType(1.0e-12) ? (float)(lr / std::sqrt(energy)) : 0.0f, std::memory_order_relaxed);
+    }
+
+    float getCorrelation() const { return correlation.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<float> correlation { 0.0f };
+};
+
+//==============================================================================
+// Lissajous view of the L/R pairs with a correlation bar underneath. Points are written
+// straight into an image that fades a little every frame, so a frame costs one pass
+// over the pixels and one drawImage no matter how many pairs arrived.
+template <typename SampleType>
+class GoniometerComponent : public juce::Component, private juce::Timer
+{
+public:
+    using Queue = StereoBufferQueue<SampleType>;
+    using Meter = CorrelationMeter<SampleType>;
+
+    GoniometerComponent(Queue& queueToUse, const Meter& meterToUse)
+        : stereoQueue(queueToUse), meter(meterToUse)
+    {
+        setOpaque(false);
+        startTimerHz(30);
+    }
+
+    void paint(juce::Graphics& g) override
+    {
+        const auto plotArea = getPlotArea();
+        g.setColour(juce::Colour::fromFloatRGBA (0.08f, 0.08f, 0.08f, 1.0f));
+        g.fillRect(plotArea);
+
+        // axes: vertical is mid, the diagonals are the left and right channels
+        g.setColour(juce::Colour::fromFloatRGBA (0.96f, 1.0f, 0.89f, 0.1f));
+        g.drawVerticalLine(plotArea.getCentreX(), (float)plotArea.getY(), (float)plotArea.getBottom());
+        g.drawHorizontalLine(plotArea.getCentreY(), (float)plotArea.getX(), (float)plotArea.getRight());
+
+        if (image.isValid())
+            g.drawImageAt(image, plotArea.getX(), plotArea.getY());
+
+        // correlation bar, filled from the centre towards the current value
+        auto barArea = getLocalBounds().removeFromBottom(barHeight).reduced(plotArea.getX() - getLocalBounds().getX(), 2).toFloat();
+        g.setColour(juce::Colour::fromFloatRGBA (0.96f, 1.0f, 0.89f, 0.1f));
+        g.fillRect(barArea);
+
+        const auto centre = barArea.getCentreX();
+        const auto value = centre + smoothedCorrelation * barArea.getWidth() * 0.5f;
+        g.setColour(smoothedCorrelation < 0 ? juce::Colour::fromFloatRGBA (0.8f, 0.3f, 0.25f, 1.0f)
+                                            : juce::Colour::fromFloatRGBA (0.2941f, 0.4784f, 0.2784f, 1.0f));
+        g.fillRect(juce::Rectangle<float>::leftTopRightBottom(juce::jmin(centre, value), barArea.getY(),
+                                                              juce::jmax(centre, value), barArea.getBottom()));
+    }
+
+    void resized() override
+    {
+        const auto plotArea = getPlotArea();
+        image = juce::Image(juce::Image::ARGB, juce::jmax(1, plotArea.getWidth()), juce::jmax(1, plotArea.getHeight()), true);
+    }
+
+private:
+    juce::Rectangle<int> getPlotArea() const
+    {
+        auto area = getLocalBounds();
+        area.removeFromBottom(barHeight);
+        const auto side = juce::jmin(area.getWidth(), area.getHeight());
+        return area.withSizeKeepingCentre(side, side);
+    }
+
+    void timerCallback() override
+    {
+        smoothedCorrelation += 0.3f * (meter.getCorrelation() - smoothedCorrelation);
+
+        if (! image.isValid())
+            return;
+
+        juce::Image::BitmapData bitmap(image, juce::Image::BitmapData::readWrite);
+
+        // fade what is already there
+        for (int y = 0; y < bitmap.height; ++y)
+        {
+            auto* line = bitmap.getLinePointer(y);
+            for (int x = 0; x < bitmap.width; ++x)
+                reinterpret_cast<juce::PixelARGB*>(line + x * bitmap.pixelStride)->multiplyAlpha(decay);
+        }
+
+        // plot the new pairs, mid up and side across
+        const auto halfW = (SampleType)bitmap.width * SampleType(0.5);
+        const auto halfH = (SampleType)bitmap.height * SampleType(0.5);
+        const auto scale = juce::jmin(halfW, halfH) * SampleType(0.7071);
+        const juce::PixelARGB dot (255, 245, 255, 227);
+
+        size_t numRead;
+        while ((numRead = stereoQueue.pop(left.data(), right.data(), left.size())) > 0)
+        {
+            for (size_t i = 0; i < numRead; ++i)
+            {
+                const auto x = (int)(halfW + (right[i] - left[i]) * scale);
+                const auto y = (int)(halfH - (left[i] + right[i]) * scale);
+
+                if (juce::isPositiveAndBelow(x, bitmap.width) && juce::isPositiveAndBelow(y, bitmap.height))
+                    *reinterpret_cast<juce::PixelARGB*>(bitmap.getPixelPointer(x, y)) = dot;
+            }
+        }
+
+        repaint();
+    }
+
+    static constexpr int barHeight = 10;
+    static constexpr juce::uint8 decay = 200;
+
+    Queue& stereoQueue;
+    const Meter& meter;
+    juce::Image image;
+    std::array<SampleType, 2048> left, right;
+    float smoothedCorrelation = 0.0f;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(GoniometerComponent)
+};
@@ -35,7 +35,7 @@ Knob::Knob(std::string suffix)
             setNumDecimalPlacesToDisplay (0);
     };
     setColour (juce::Slider::textBoxTextColourId, juce::Colour::fromFloatRGBA (0.96f, 1.0f, 0.89f, 1.0f));
-    setLookAndFeel (&customLookAndFeel);
+    setLookAndFeel (&sharedResources->dialLookAndFeel);
 }
 
 Knob::~Knob()
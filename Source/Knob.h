@@ -9,7 +9,7 @@
 */
 
 #pragma once
-#include "CustomLookAndFeel.h"
+#include "SharedResources.h"
 
 class Knob : public juce::Slider
 {
@@ -18,6 +18,6 @@ public:
     ~Knob();
     
 private:
-    CustomDial customLookAndFeel;
+    juce::SharedResourcePointer<SharedResources> sharedResources;
 };
 
@@ -19,11 +19,13 @@
 
 
 #pragma once
-#include "../JuceLibraryCode/JuceHeader.h"
+#include <JuceHeader.h>
 #include <array>
+#include <vector>
 
 
-//Template class - holds sample data to be displayed in the scope
+//Template class - lock free single producer/single consumer ring of raw scope samples.
+//The audio thread only pushes, all trigger analysis happens on the reading side.
 template <typename SampleType>
 class AudioBufferQueue
 {
@@ -32,52 +34,47 @@ public:
     // constants
     static constexpr size_t order = 9;
     static constexpr size_t bufferSize = 1U << order;
-    static constexpr size_t numBuffers = 5;
+    // one 24 fps frame at 192 kHz is 8000 samples; history for zooming out lives in the
+    // reader's pyramid, so the ring only has to bridge the gap between two timer callbacks
+    static constexpr size_t fifoSize = 1U << 13;
 
-    //Fifo
+    //Fifo, samples that don't fit are dropped (the reader is too slow or the editor is closed)
     void push(const SampleType* dataToPush, size_t numSamples)
     {
-       
-        jassert(numSamples <= bufferSize);
         int start1, size1, start2, size2;
-        abstractFifo.prepareToWrite(1, start1, size1, start2, size2);
-
-        jassert(size1 <= 1);
-        jassert(size2 == 0);
+        abstractFifo.prepareToWrite((int)numSamples, start1, size1, start2, size2);
 
-        if (size1 > 0) {
-            juce::FloatVectorOperations::copy(buffers[(size_t)start1].data(), dataToPush, (int)juce::jmin(bufferSize, numSamples));
-        }
+        if (size1 > 0)
+            juce::FloatVectorOperations::copy(buffer.data() + start1, dataToPush, size1);
+        if (size2 > 0)
+            juce::FloatVectorOperations::copy(buffer.data() + start2, dataToPush + size1, size2);
         
-        abstractFifo.finishedWrite(size1);
-      
+        abstractFifo.finishedWrite(size1 + size2);
     }
 
-    void pop(SampleType* outputBuffer)
+    // returns the number of samples copied into outputBuffer
+    size_t pop(SampleType* outputBuffer, size_t maxSamples)
     {
-       
         int start1, size1, start2, size2;
-        abstractFifo.prepareToRead(1, start1, size1, start2, size2);
-
-        jassert(size1 <= 1);
-        jassert(size2 == 0);
+        abstractFifo.prepareToRead((int)maxSamples, start1, size1, start2, size2);
 
-        if (size1 > 0) {
-            juce::FloatVectorOperations::copy(outputBuffer, buffers[(size_t)start1].data(), (int)bufferSize);
-        }
-        abstractFifo.finishedRead(size1);
+        if (size1 > 0)
+            juce::FloatVectorOperations::copy(outputBuffer, buffer.data() + start1, size1);
+        if (size2 > 0)
+            juce::FloatVectorOperations::copy(outputBuffer + size1, buffer.data() + start2, size2);
         
+        abstractFifo.finishedRead(size1 + size2);
+        return (size_t)(size1 + size2);
     }
 
 private:
-    //container to hold audio buffer for plotting, passing the num of elements to Fifo
-    std::array <std::array<SampleType, bufferSize>, numBuffers> buffers;
-    juce::AbstractFifo abstractFifo{ numBuffers };
+    std::array<SampleType, fifoSize> buffer;
+    juce::AbstractFifo abstractFifo{ (int)fifoSize };
 
 };
 
 //==============================================================================
-// A class that collects sample data from the DSP audio buffer and adds the sample data to the AudioBufferQueue object.
+// Audio thread side of the scope: hands the raw samples to the AudioBufferQueue, nothing else.
 template<typename SampleType>
 class ScopeDataCollector
 {
@@ -88,60 +85,304 @@ public:
 
     void process(const SampleType* data, size_t numSamples)
     {
-        size_t index = 0;
-            
-        if (currentState == State::WaitingForTrigger)
+        audioBufferQueue.push(data, numSamples);
+    }
+
+private:
+    AudioBufferQueue<SampleType>& audioBufferQueue;
+};
+
+//==============================================================================
+// GUI side of the scope: drains the AudioBufferQueue into a history, finds a level/slope
+// trigger and, with period lock on, keeps the trigger at the same phase of the waveform
+// by stepping whole periods (found with autocorrelation) from the last trigger.
+template<typename SampleType>
+class ScopeTrigger
+{
+public:
+    using Queue = AudioBufferQueue<SampleType>;
+    
+    enum class Slope
+    {
+        rising,
+        falling,
+        freeRun
+    };
+    
+    static constexpr size_t displaySize = Queue::bufferSize;
+    static constexpr size_t historySize = displaySize * 8;
+    
+    ScopeTrigger()
+    {
+        history.fill(SampleType(0));
+        candidates.reserve(historySize);
+    }
+    
+    void setLevel(SampleType newLevel) { level = newLevel; }
+    SampleType getLevel() const { return level; }
+    
+    void setSlope(Slope newSlope) { slope = newSlope; }
+    Slope getSlope() const { return slope; }
+    
+    void setPeriodLock(bool shouldLock) { periodLock = shouldLock; period = 0; }
+    bool getPeriodLock() const { return periodLock; }
+    
+    // Writes the triggered window to display into dest (displaySize samples).
+    void getWindow(SampleType* dest)
+    {
+        const auto start = findWindowStart();
+        std::copy(history.begin() + (std::ptrdiff_t)start, history.begin() + (std::ptrdiff_t)(start + displaySize), dest);
+    }
+
+    void push(const SampleType* data, size_t numSamples)
+    {
+        if (numSamples >= historySize)
+        {
+            std::copy(data + numSamples - historySize, data + numSamples, history.begin());
+        }
+        else
         {
-            while (index++ < numSamples)
+            std::move(history.begin() + (std::ptrdiff_t)numSamples, history.end(), history.begin());
+            std::copy(data, data + numSamples, history.end() - (std::ptrdiff_t)numSamples);
+        }
+        totalSamples += (juce::int64)numSamples;
+    }
+
+private:
+    size_t findWindowStart()
+    {
+        constexpr size_t latestStart = historySize - displaySize;
+        
+        if (slope == Slope::freeRun)
+            return latestStart;
+        
+        findCandidates(latestStart);
+        
+        if (candidates.empty())
+        {
+            lastTrigger = -1;
+            return latestStart;
+        }
+        
+        const auto firstAbs = totalSamples - (juce::int64)historySize;
+        auto start = candidates.back();
+        
+        if (periodLock)
+        {
+            updatePeriod();
+            
+            if (period > 0 && lastTrigger >= firstAbs)
             {
-                auto currentSample = *data++;
-              
-                if (currentSample >= triggerLevel && prevSample < triggerLevel)
+                // step whole periods from the previous trigger and snap to the closest crossing
+                const auto steps = ((firstAbs + (juce::int64)latestStart) - lastTrigger) / period;
+                const auto projected = (size_t)(lastTrigger + steps * period - firstAbs);
+                const auto tolerance = (size_t)juce::jmax((juce::int64)1, period / 4);
+                
+                start = projected;
+                auto bestDistance = tolerance;
+                for (auto c : candidates)
                 {
-                    //change here to reset the line
-                    numCollected = 0;
-                    currentState = State::Collecting;
-                    break;
+                    const auto distance = c > projected ? c - projected : projected - c;
+                    if (distance <= bestDistance)
+                    {
+                        bestDistance = distance;
+                        start = c;
+                    }
                 }
-             
-                prevSample = currentSample;
-
             }
         }
+        
+        lastTrigger = firstAbs + (juce::int64)start;
+        return start;
+    }
+    
+    // crossings of level in the requested direction, with a little hysteresis against noise
+    void findCandidates(size_t latestStart)
+    {
+        candidates.clear();
+        const auto sign = slope == Slope::rising ? SampleType(1) : SampleType(-1);
+        const auto threshold = sign * level;
+        bool armed = false;
+        
+        for (size_t i = 0; i <= latestStart; ++i)
+        {
+            const auto sample = sign * history[i];
+            
+            if (sample < threshold - hysteresis)
+                armed = true;
+            else if (armed && sample >= threshold)
+            {
+                candidates.push_back(i);
+                armed = false;
+            }
+        }
+    }
+    
+    // first autocorrelation peak after the first zero crossing of the normalised autocorrelation
+    void updatePeriod()
+    {
+        constexpr size_t analysisSize = displaySize * 2;
+        constexpr size_t minLag = 8;
+        constexpr size_t maxLag = displaySize;
+        const auto* data = history.data() + historySize - analysisSize;
+        
+        SampleType energy = 0;
+        for (size_t i = 0; i < analysisSize; ++i)
+            energy += data[i] * data[i];
+        
+        if (energy < SampleType(1.0e-6))
+        {
+            period = 0;
+            return;
+        }
+        
+        bool dipped = false;
+        SampleType bestValue = SampleType(0.5);
+        size_t bestLag = 0;
+        
+        for (size_t lag = minLag; lag <= maxLag; ++lag)
+        {
+            const auto n = analysisSize - lag;
+            SampleType sum = 0;
+            for (size_t i = 0; i < n; ++i)
+                sum += data[i] * data[i + lag];
+            
+            const auto r = sum * (SampleType)analysisSize / ((SampleType)n * energy);
+            
+            if (! dipped)
+                dipped = r < SampleType(0);
+            else if (r > bestValue)
+            {
+                bestValue = r;
+                bestLag = lag;
+            }
+            else if (bestLag != 0 && r < SampleType(0))
+                break;
+        }
+        
+        // keep the old period on small drifts so the lock does not wobble
+        if (bestLag == 0)
+            period = 0;
+        else if (std::abs((juce::int64)bestLag - period) > period / 50)
+            period = (juce::int64)bestLag;
+    }
+    
+    static constexpr auto hysteresis = SampleType(0.01);
+    
+    std::array<SampleType, historySize> history;
+    std::vector<size_t> candidates;
+    juce::int64 totalSamples = 0;
+    juce::int64 lastTrigger = -1;
+    juce::int64 period = 0;
+    
+    SampleType level = SampleType(0);
+    Slope slope = Slope::rising;
+    bool periodLock = true;
+};
+
+//==============================================================================
+// GUI side history for zoomed out views: min/max bins at a few resolutions, each level
+// merging fanOut bins of the one below. Every level is a fixed ring, so memory does not
+// depend on the zoom and the top level reaches back several seconds.
+template<typename SampleType>
+class ScopePyramid
+{
+public:
+    static constexpr size_t numLevels = 4;
+    static constexpr size_t fanOut = 4;
+    static constexpr size_t levelSize = 4096;
+
+    struct Bin
+    {
+        SampleType min;
+        SampleType max;
+    };
 
-        if (currentState == State::Collecting)
+    static constexpr size_t getBinSize(size_t level) { return level == 0 ? fanOut : fanOut * getBinSize(level - 1); }
+    static constexpr size_t getMaxSamples() { return getBinSize(numLevels - 1) * levelSize; }
+
+    ScopePyramid()
+    {
+        for (auto& level : levels)
+            level.bins.fill({ SampleType(0), SampleType(0) });
+    }
+
+    void push(const SampleType* data, size_t numSamples)
+    {
+        for (size_t i = 0; i < numSamples; ++i)
+            add(0, { data[i], data[i] });
+    }
+
+    // Min/max of the latest numSamples in numColumns columns, oldest first, read from the
+    // coarsest level that still has a bin for every column. Columns older than the
+    // captured history come back as silence.
+    void render(size_t numSamples, Bin* columns, size_t numColumns) const
+    {
+        if (numColumns == 0)
+            return;
+
+        size_t levelIndex = 0;
+        for (size_t l = numLevels; l-- > 0;)
         {
-            while (index++ < numSamples)
+            if (numSamples / getBinSize(l) >= numColumns)
             {
-               
-                buffer[numCollected++] = *data++;
+                levelIndex = l;
+                break;
+            }
+        }
 
-                if (numCollected == buffer.size())
-                {
-                    audioBufferQueue.push(buffer.data(), buffer.size());
-                    currentState = State::WaitingForTrigger;
-                    prevSample = SampleType(100);
-                    break;
-                }
+        const auto& level = levels[levelIndex];
+        const auto wanted = juce::jlimit((size_t)1, levelSize, numSamples / getBinSize(levelIndex));
+        const auto available = juce::jmin(wanted, level.count);
+        const auto missing = wanted - available;
+
+        for (size_t c = 0; c < numColumns; ++c)
+        {
+            const auto begin = c * wanted / numColumns;
+            const auto end = juce::jmax(begin + 1, (c + 1) * wanted / numColumns);
+            Bin column { SampleType(0), SampleType(0) };
+            bool first = true;
+
+            for (auto b = juce::jmax(begin, missing); b < end; ++b)
+            {
+                const auto& bin = level.bins[(level.writeIndex + levelSize - wanted + b) % levelSize];
+                column.min = first ? bin.min : juce::jmin(column.min, bin.min);
+                column.max = first ? bin.max : juce::jmax(column.max, bin.max);
+                first = false;
             }
+            columns[c] = column;
         }
     }
 
 private:
-   
-    enum class State
+    struct Level
     {
-        WaitingForTrigger,
-        Collecting
+        std::array<Bin, levelSize> bins;
+        size_t writeIndex = 0;
+        size_t count = 0;
+        Bin pending { SampleType(0), SampleType(0) };
+        size_t numPending = 0;
     };
 
-    static constexpr auto triggerLevel = SampleType(0.001);
+    void add(size_t levelIndex, Bin bin)
+    {
+        auto& level = levels[levelIndex];
+        level.pending.min = level.numPending == 0 ? bin.min : juce::jmin(level.pending.min, bin.min);
+        level.pending.max = level.numPending == 0 ? bin.max : juce::jmax(level.pending.max, bin.max);
 
-    std::array<SampleType, AudioBufferQueue<SampleType>::bufferSize> buffer;
-    State currentState{ State::WaitingForTrigger };
-    AudioBufferQueue<SampleType>& audioBufferQueue;
-    size_t numCollected;
-    SampleType prevSample = SampleType(100);
+        if (++level.numPending < fanOut)
+            return;
+
+        level.bins[level.writeIndex] = level.pending;
+        level.writeIndex = (level.writeIndex + 1) % levelSize;
+        level.count = juce::jmin(level.count + 1, levelSize);
+        level.numPending = 0;
+
+        if (levelIndex + 1 < numLevels)
+            add(levelIndex + 1, level.pending);
+    }
+
+    std::array<Level, numLevels> levels;
 };
 
 // A class of GUI components that plots and draws sample data stored in the AudioBufferQueue object.
@@ -153,14 +394,31 @@ class ScopeComponent : public juce::Component, private juce::Timer
 public:
     using Queue = AudioBufferQueue<SampleType>;
 
+    //==============================================================================
+    using Trigger = ScopeTrigger<SampleType>;
+    using Pyramid = ScopePyramid<SampleType>;
+
     //==============================================================================
     ScopeComponent (Queue& queueToUse)
         : audioBufferQueue (queueToUse)
     {
         sampleData.fill (SampleType (0));
+        columns.resize (1);
         setFramesPerSecond (24);
     }
 
+    //==============================================================================
+    void setTriggerLevel (SampleType level)           { trigger.setLevel (level); }
+    void setTriggerSlope (typename Trigger::Slope s)  { trigger.setSlope (s); }
+    void setPeriodLock (bool shouldLock)              { trigger.setPeriodLock (shouldLock); }
+    void setSampleRate (double newSampleRate)         { sampleRate = newSampleRate; }
+
+    // samples across the width; Queue::bufferSize shows the triggered view, more scrolls the pyramid
+    void setVisibleSamples (size_t numSamples)
+    {
+        visibleSamples = juce::jlimit ((size_t) Queue::bufferSize, Pyramid::getMaxSamples(), numSamples);
+    }
+
     //==============================================================================
     void setFramesPerSecond (int framesPerSecond)
     {
@@ -172,12 +430,8 @@ public:
     //==============================================================================
     void paint(juce::Graphics& g) override
     {
-        int panelNameHeight = 20;
-        
         // area for the plotting
-        juce::Rectangle<int> drawArea = getLocalBounds();
-        drawArea.removeFromTop(panelNameHeight);
-        drawArea.reduce(drawArea.getWidth()* 0.05f, drawArea.getHeight()* 0.01f);
+        juce::Rectangle<int> drawArea = getPlotArea();
 
         // background colour
         g.setColour(juce::Colour::fromFloatRGBA (0.08f, 0.08f, 0.08f, 1.0f));
@@ -189,22 +443,123 @@ public:
         SampleType drawW = (SampleType)drawArea.getWidth();
         juce::Rectangle<SampleType> scopeRect = juce::Rectangle<SampleType>{ drawX, drawY, drawW, drawH };
 
+        // timebase
+        g.setColour(juce::Colour::fromFloatRGBA (0.96f, 1.0f, 0.89f, 0.5f));
+        g.setFont(10.0f);
+        const auto timebase = sampleRate > 0 ? juce::String (1000.0 * (double) visibleSamples / sampleRate, 1) + " ms"
+                                             : juce::String ((int) visibleSamples) + " smp";
+        g.drawText(timebase, drawArea.withY(0).withHeight(drawArea.getY()), juce::Justification::bottomRight);
+
+        if (visibleSamples > Queue::bufferSize)
+        {
+            // zoomed out: one min/max column per pixel from the pyramid
+            g.setColour(juce::Colour::fromFloatRGBA (0.96f, 1.0f, 0.89f, 1.0f));
+            plotColumns(columns.data(), juce::jmin(columns.size(), (size_t) drawArea.getWidth()), g, scopeRect, plotScaler);
+            return;
+        }
+
+        // trigger level
+        const auto levelY = scopeRect.getBottom() - scopeRect.getHeight() / 2 - scopeRect.getHeight() * plotScaler * trigger.getLevel();
+        g.setColour(juce::Colour::fromFloatRGBA (0.96f, 1.0f, 0.89f, 0.15f));
+        g.drawHorizontalLine((int)levelY, drawX, drawX + drawW);
+
         // colour of waveform
         g.setColour(juce::Colour::fromFloatRGBA (0.96f, 1.0f, 0.89f, 1.0f));
 
         // call the plot function
-        plot(sampleData.data(), sampleData.size(), g, scopeRect, SampleType(0.4), scopeRect.getHeight() / 2);
+        plot(sampleData.data(), sampleData.size(), g, scopeRect, plotScaler, scopeRect.getHeight() / 2);
     }
 
-    void resized() override {}
+    void resized() override
+    {
+        columns.resize ((size_t) juce::jmax (1, getPlotArea().getWidth()));
+    }
+
+    void mouseWheelMove (const juce::MouseEvent&, const juce::MouseWheelDetails& wheel) override
+    {
+        if (wheel.deltaY == 0.0f)
+            return;
+
+        const auto factor = wheel.deltaY > 0 ? 0.8 : 1.25;
+        setVisibleSamples ((size_t) ((double) visibleSamples * factor));
+        repaint();
+    }
+    
+    // left click sets the trigger level, right click picks slope and period lock,
+    // the mouse wheel zooms the timebase
+    void mouseDown (const juce::MouseEvent& e) override
+    {
+        if (e.mods.isPopupMenu())
+        {
+            using Slope = typename Trigger::Slope;
+            juce::PopupMenu menu;
+            menu.addItem (1, "Rising edge", true, trigger.getSlope() == Slope::rising);
+            menu.addItem (2, "Falling edge", true, trigger.getSlope() == Slope::falling);
+            menu.addItem (3, "Free run", true, trigger.getSlope() == Slope::freeRun);
+            menu.addSeparator();
+            menu.addItem (4, "Period lock", true, trigger.getPeriodLock());
+            
+            menu.showMenuAsync (juce::PopupMenu::Options(), [this] (int result)
+            {
+                if (result >= 1 && result <= 3)
+                    trigger.setSlope ((Slope) (result - 1));
+                else if (result == 4)
+                    trigger.setPeriodLock (! trigger.getPeriodLock());
+            });
+            return;
+        }
+        
+        const auto area = getPlotArea().toFloat();
+        const auto gain = area.getHeight() * plotScaler;
+        const auto centre = area.getBottom() - area.getHeight() / 2;
+        trigger.setLevel (juce::jlimit (SampleType (-1), SampleType (1), (SampleType) ((centre - e.position.y) / gain)));
+    }
 
 private:
+    juce::Rectangle<int> getPlotArea() const
+    {
+        int panelNameHeight = 20;
+        
+        juce::Rectangle<int> drawArea = getLocalBounds();
+        drawArea.removeFromTop(panelNameHeight);
+        drawArea.reduce(drawArea.getWidth()* 0.05f, drawArea.getHeight()* 0.01f);
+        return drawArea;
+    }
+    
     void timerCallback() override
     {
-        audioBufferQueue.pop(sampleData.data());
+        size_t numRead;
+        while ((numRead = audioBufferQueue.pop(scratch.data(), scratch.size())) > 0)
+        {
+            trigger.push(scratch.data(), numRead);
+            pyramid.push(scratch.data(), numRead);
+        }
+
+        if (visibleSamples > Queue::bufferSize)
+            pyramid.render(visibleSamples, columns.data(), columns.size());
+        else
+            trigger.getWindow(sampleData.data());
+
         repaint();
     }
 
+    static void plotColumns(const typename Pyramid::Bin* data
+        , size_t numColumns
+        , juce::Graphics& g
+        , juce::Rectangle<SampleType> rect
+        , SampleType scaler)
+    {
+        auto centre = rect.getCentreY();
+        auto gain = rect.getHeight() * scaler;
+
+        for (size_t i = 0; i < numColumns; ++i)
+        {
+            const float top = centre - gain * juce::jlimit(SampleType(-1.0), SampleType(1.0), data[i].max);
+            const float bottom = centre - gain * juce::jlimit(SampleType(-1.0), SampleType(1.0), data[i].min);
+            g.drawVerticalLine((int)rect.getX() + (int)i, top, bottom + 1.0f);
+        }
+    }
+
     static void plot(const SampleType* data
         , size_t numSamples
         , juce::Graphics& g
@@ -231,7 +586,15 @@ private:
         
     }
    
+    static constexpr auto plotScaler = SampleType(0.4);
+    
     Queue& audioBufferQueue;
+    Trigger trigger;
+    Pyramid pyramid;
+    std::array<SampleType, 4096> scratch;
     std::array<SampleType, Queue::bufferSize> sampleData;
+    std::vector<typename Pyramid::Bin> columns;
+    size_t visibleSamples = Queue::bufferSize;
+    double sampleRate = 0;
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(ScopeComponent)
 };
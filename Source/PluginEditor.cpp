@@ -11,7 +11,8 @@
 
 //==============================================================================
 Dist0322AudioProcessorEditor::Dist0322AudioProcessorEditor (Dist0322AudioProcessor& p)
-    : AudioProcessorEditor (&p), audioProcessor (p) ,scopeComponent(p.getAudioBufferQueue())
+    : AudioProcessorEditor (&p), audioProcessor (p) ,scopeComponent(p.getAudioBufferQueue()),
+      goniometer(p.getStereoBufferQueue(), p.getCorrelationMeter())
 {
     // Make sure that before the constructor has finished, you've set the
     // editor's size to whatever you need it to be.
@@ -35,6 +36,14 @@ Dist0322AudioProcessorEditor::Dist0322AudioProcessorEditor (Dist0322AudioProcess
     driveKnob.setTextBoxStyle(juce::Slider::TextBoxBelow, false, 50, 20);
     addAndMakeVisible(driveKnob);
     
+    sideAttachment = std::make_unique<juce::AudioProcessorValueTreeState::SliderAttachment>(audioProcessor.apvts, "SIDE", sideKnob);
+    sideKnob.setTextBoxStyle(juce::Slider::TextBoxBelow, false, 50, 20);
+    addAndMakeVisible(sideKnob);
+    
+    biasAttachment = std::make_unique<juce::AudioProcessorValueTreeState::SliderAttachment>(audioProcessor.apvts, "BIAS", biasKnob);
+    biasKnob.setTextBoxStyle(juce::Slider::TextBoxBelow, false, 50, 20);
+    addAndMakeVisible(biasKnob);
+    
     mixAttachment = std::make_unique<juce::AudioProcessorValueTreeState::SliderAttachment>(audioProcessor.apvts, "MIX", mixKnob);
   //  mixKnob.addListener(this);
     mixKnob.setTextBoxStyle(juce::Slider::TextBoxBelow, false, 50, 20);
@@ -46,6 +55,54 @@ Dist0322AudioProcessorEditor::Dist0322AudioProcessorEditor (Dist0322AudioProcess
     outputKnob.setTextBoxStyle(juce::Slider::TextBoxBelow, false, 50, 20);
     addAndMakeVisible(outputKnob);
     
+    //Stereo mode, items must be added before the attachment picks the current one
+    stereoBox.addItemList(audioProcessor.apvts.getParameter("STEREO")->getAllValueStrings(), 1);
+    stereoBox.setColour(juce::ComboBox::backgroundColourId, juce::Colour::fromFloatRGBA (0.08f, 0.08f, 0.08f, 1.0f));
+    stereoBox.setColour(juce::ComboBox::textColourId, juce::Colour::fromFloatRGBA (0.96f, 1.0f, 0.89f, 1.0f));
+    stereoBox.setColour(juce::ComboBox::outlineColourId, juce::Colour::fromFloatRGBA (0.96f, 1.0f, 0.89f, 0.3f));
+    stereoAttachment = std::make_unique<juce::AudioProcessorValueTreeState::ComboBoxAttachment>(audioProcessor.apvts, "STEREO", stereoBox);
+    addAndMakeVisible(stereoBox);
+    
+    //Clipper curve
+    clipperBox.addItemList(audioProcessor.apvts.getParameter("CLIPPER")->getAllValueStrings(), 1);
+    clipperBox.setColour(juce::ComboBox::backgroundColourId, juce::Colour::fromFloatRGBA (0.08f, 0.08f, 0.08f, 1.0f));
+    clipperBox.setColour(juce::ComboBox::textColourId, juce::Colour::fromFloatRGBA (0.96f, 1.0f, 0.89f, 1.0f));
+    clipperBox.setColour(juce::ComboBox::outlineColourId, juce::Colour::fromFloatRGBA (0.96f, 1.0f, 0.89f, 0.3f));
+    clipperAttachment = std::make_unique<juce::AudioProcessorValueTreeState::ComboBoxAttachment>(audioProcessor.apvts, "CLIPPER", clipperBox);
+    addAndMakeVisible(clipperBox);
+    
+    //Loudness matched output
+    autoGainButton.setColour(juce::ToggleButton::textColourId, juce::Colour::fromFloatRGBA (0.96f, 1.0f, 0.89f, 1.0f));
+    autoGainButton.setColour(juce::ToggleButton::tickColourId, juce::Colour::fromFloatRGBA (0.96f, 1.0f, 0.89f, 1.0f));
+    autoGainAttachment = std::make_unique<juce::AudioProcessorValueTreeState::ButtonAttachment>(audioProcessor.apvts, "AUTOGAIN", autoGainButton);
+    addAndMakeVisible(autoGainButton);
+    
+    //Cabinet IR
+    cabButton.setColour(juce::ToggleButton::textColourId, juce::Colour::fromFloatRGBA (0.96f, 1.0f, 0.89f, 1.0f));
+    cabButton.setColour(juce::ToggleButton::tickColourId, juce::Colour::fromFloatRGBA (0.96f, 1.0f, 0.89f, 1.0f));
+    cabAttachment = std::make_unique<juce::AudioProcessorValueTreeState::ButtonAttachment>(audioProcessor.apvts, "CAB", cabButton);
+    addAndMakeVisible(cabButton);
+    
+    loadIRButton.setColour(juce::TextButton::buttonColourId, juce::Colour::fromFloatRGBA (0.08f, 0.08f, 0.08f, 1.0f));
+    loadIRButton.setColour(juce::TextButton::textColourOffId, juce::Colour::fromFloatRGBA (0.96f, 1.0f, 0.89f, 1.0f));
+    if (audioProcessor.getImpulseResponseFile().existsAsFile())
+        loadIRButton.setButtonText(audioProcessor.getImpulseResponseFile().getFileNameWithoutExtension());
+    loadIRButton.onClick = [this]()
+    {
+        irChooser = std::make_unique<juce::FileChooser>("Load impulse response", audioProcessor.getImpulseResponseFile(), "*.wav;*.aif;*.aiff");
+        irChooser->launchAsync(juce::FileBrowserComponent::openMode | juce::FileBrowserComponent::canSelectFiles,
+                               [this] (const juce::FileChooser& chooser)
+        {
+            const auto file = chooser.getResult();
+            if (! file.existsAsFile())
+                return;
+            
+            audioProcessor.loadImpulseResponse(file);
+            loadIRButton.setButtonText(file.getFileNameWithoutExtension());
+        });
+    };
+    addAndMakeVisible(loadIRButton);
+    
     //Labels
     inputLabel.setText ("IN", juce::dontSendNotification);
     inputLabel.setJustificationType(juce::Justification::centred);
@@ -63,6 +120,22 @@ Dist0322AudioProcessorEditor::Dist0322AudioProcessorEditor (Dist0322AudioProcess
     driveLabel.attachToComponent(&driveKnob, false);
     addAndMakeVisible (driveLabel);
 
+    sideLabel.setText ("SIDE", juce::dontSendNotification);
+    sideLabel.setJustificationType(juce::Justification::centred);
+    sideLabel.setColour(0x1000281, juce::Colour::fromFloatRGBA (0.96f, 1.0f, 0.89f, 1.0f));
+    sideLabel.setFont (juce::Font (14.0f));
+    sideLabel.setInterceptsMouseClicks(false, false);
+    sideLabel.attachToComponent(&sideKnob, false);
+    addAndMakeVisible (sideLabel);
+
+    biasLabel.setText ("BIAS", juce::dontSendNotification);
+    biasLabel.setJustificationType(juce::Justification::centred);
+    biasLabel.setColour(0x1000281, juce::Colour::fromFloatRGBA (0.96f, 1.0f, 0.89f, 1.0f));
+    biasLabel.setFont (juce::Font (14.0f));
+    biasLabel.setInterceptsMouseClicks(false, false);
+    biasLabel.attachToComponent(&biasKnob, false);
+    addAndMakeVisible (biasLabel);
+
     mixLabel.setText ("MIX", juce::dontSendNotification);
     mixLabel.setJustificationType(juce::Justification::centred);
     mixLabel.setColour(0x1000281, juce::Colour::fromFloatRGBA (0.96f, 1.0f, 0.89f, 1.0f));
@@ -86,7 +159,9 @@ Dist0322AudioProcessorEditor::Dist0322AudioProcessorEditor (Dist0322AudioProcess
     title.setInterceptsMouseClicks(false, false);
     addAndMakeVisible (title);
     
+    scopeComponent.setSampleRate(audioProcessor.getSampleRate());
     addAndMakeVisible(scopeComponent);
+    addAndMakeVisible(goniometer);
     addAndMakeVisible (line);
 }
 
@@ -117,18 +192,28 @@ void Dist0322AudioProcessorEditor::resized()
     lineArea.reduce(lineArea.getWidth()* 0.05f, lineArea.getHeight()* 0.1f);
     juce::Rectangle<int> sliderArea = area.removeFromTop(area.getHeight()/2);
     sliderArea.reduce(sliderArea.getWidth()* 0.05f, sliderArea.getHeight()* 0.001f);
-    juce::Rectangle<int> inputSliderArea = sliderArea.removeFromLeft(sliderArea.getWidth()/4);
-    juce::Rectangle<int> driveSliderArea = sliderArea.removeFromLeft(sliderArea.getWidth()/3);
+    juce::Rectangle<int> inputSliderArea = sliderArea.removeFromLeft(sliderArea.getWidth()/6);
+    juce::Rectangle<int> driveSliderArea = sliderArea.removeFromLeft(sliderArea.getWidth()/5);
+    juce::Rectangle<int> sideSliderArea = sliderArea.removeFromLeft(sliderArea.getWidth()/4);
+    juce::Rectangle<int> biasSliderArea = sliderArea.removeFromLeft(sliderArea.getWidth()/3);
     juce::Rectangle<int> mixSliderArea = sliderArea.removeFromLeft(sliderArea.getWidth()/2);
 
     title.setBounds(widthMargin * 0.1, heightMargin * 0.05, 80, 30);
+    stereoBox.setBounds(getWidth() - widthMargin * 0.1 - 70, heightMargin * 0.15, 70, 20);
+    autoGainButton.setBounds(stereoBox.getX() - 95, heightMargin * 0.15, 90, 20);
+    loadIRButton.setBounds(autoGainButton.getX() - 75, heightMargin * 0.15, 70, 20);
+    cabButton.setBounds(loadIRButton.getX() - 55, heightMargin * 0.15, 50, 20);
+    clipperBox.setBounds(cabButton.getX() - 75, heightMargin * 0.15, 70, 20);
    
     //title.setBounds(titleArea);
     line.setBounds(lineArea);
     inputKnob.setBounds(inputSliderArea);
     driveKnob.setBounds(driveSliderArea);
+    sideKnob.setBounds(sideSliderArea);
+    biasKnob.setBounds(biasSliderArea);
     mixKnob.setBounds(mixSliderArea);
     outputKnob.setBounds(sliderArea);
+    goniometer.setBounds(area.removeFromRight(area.getHeight()).reduced(0, area.getHeight() * 0.05f));
     scopeComponent.setBounds(area);
     scopeComponent.repaint();
 
@@ -43,23 +43,35 @@ public:
     
     //void sliderValueChanged(juce::Slider* slider) override;
     
-    Knob inputKnob{" dB"}, driveKnob{" dB"}, mixKnob{" %"}, outputKnob{" dB"};
+    Knob inputKnob{" dB"}, driveKnob{" dB"}, sideKnob{" dB"}, biasKnob{" %"}, mixKnob{" %"}, outputKnob{" dB"};
 
 private:
     // This reference is provided as a quick way for your editor to
     // access the processor object that created it.
     Dist0322AudioProcessor& audioProcessor;
-    //send parameter to constructor
-    CustomDial customLookAndFeel;
-    
     lineComponent line;
    
     
-    juce::Label inputLabel, driveLabel, mixLabel, outputLabel, title;
+    juce::Label inputLabel, driveLabel, sideLabel, biasLabel, mixLabel, outputLabel, title;
 
-    std::unique_ptr<juce::AudioProcessorValueTreeState::SliderAttachment>inputAttachment, driveAttachment, mixAttachment, outputAttachment;
+    std::unique_ptr<juce::AudioProcessorValueTreeState::SliderAttachment>inputAttachment, driveAttachment, sideAttachment, biasAttachment, mixAttachment, outputAttachment;
+    
+    juce::ComboBox stereoBox;
+    std::unique_ptr<juce::AudioProcessorValueTreeState::ComboBoxAttachment> stereoAttachment;
+    
+    juce::ComboBox clipperBox;
+    std::unique_ptr<juce::AudioProcessorValueTreeState::ComboBoxAttachment> clipperAttachment;
+    
+    juce::ToggleButton autoGainButton {"AUTO GAIN"};
+    std::unique_ptr<juce::AudioProcessorValueTreeState::ButtonAttachment> autoGainAttachment;
+    
+    juce::ToggleButton cabButton {"CAB"};
+    std::unique_ptr<juce::AudioProcessorValueTreeState::ButtonAttachment> cabAttachment;
+    juce::TextButton loadIRButton {"LOAD IR"};
+    std::unique_ptr<juce::FileChooser> irChooser;
     
     ScopeComponent<float> scopeComponent;
+    GoniometerComponent<float> goniometer;
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (Dist0322AudioProcessorEditor)
 };
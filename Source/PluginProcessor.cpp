@@ -23,19 +23,24 @@ Dist0322AudioProcessor::Dist0322AudioProcessor()
 scopeDataCollector(scopeDataQueue)
 #endif
 {
-    apvts.addParameterListener("INPUT", this);
-    apvts.addParameterListener("OUTPUT", this);
-    apvts.addParameterListener("MIX", this);
-    apvts.addParameterListener("DRIVE", this);
-    
+    // the audio thread polls these once per block instead of being called back from
+    // whichever thread changed the parameter
+    inputParam = apvts.getRawParameterValue("INPUT");
+    driveParam = apvts.getRawParameterValue("DRIVE");
+    sideParam = apvts.getRawParameterValue("SIDE");
+    biasParam = apvts.getRawParameterValue("BIAS");
+    stereoParam = apvts.getRawParameterValue("STEREO");
+    clipperParam = apvts.getRawParameterValue("CLIPPER");
+    mixParam = apvts.getRawParameterValue("MIX");
+    outputParam = apvts.getRawParameterValue("OUTPUT");
+    autoGainParam = apvts.getRawParameterValue("AUTOGAIN");
+    cabParam = apvts.getRawParameterValue("CAB");
+    bypassParam = apvts.getRawParameterValue("BYPASS");
 }
 
 Dist0322AudioProcessor::~Dist0322AudioProcessor()
 {
-    apvts.removeParameterListener("INPUT", this);
-    apvts.removeParameterListener("OUTPUT", this);
-    apvts.removeParameterListener("MIX", this);
-    apvts.removeParameterListener("DRIVE", this);
+    cancelPendingUpdate();
 }
 
 //==============================================================================
@@ -73,7 +78,11 @@ bool Dist0322AudioProcessor::isMidiEffect() const
 
 double Dist0322AudioProcessor::getTailLengthSeconds() const
 {
-    return 0.0;
+    // never ask the convolution itself, its engine is swapped on the audio thread
+    if (cabParam->load() < 0.5f || ! hasImpulseResponse.load() || getSampleRate() <= 0)
+        return 0.0;
+    
+    return (double) irLength.load() / getSampleRate();
 }
 
 int Dist0322AudioProcessor::getNumPrograms()
@@ -110,8 +119,32 @@ void Dist0322AudioProcessor::prepareToPlay (double sampleRate, int samplesPerBlo
    
     inputDB.reset(sampleRate, 0.02f);
     driveDB.reset(sampleRate, 0.02f);
+    sideDriveDB.reset(sampleRate, 0.02f);
+    bias.reset(sampleRate, 0.02f);
+    dcBlock.reset(sampleRate, 0.02f);
     mix.reset(sampleRate, 0.02f);
     outputDB.reset(sampleRate, 0.02f);
+    cabMix.reset(sampleRate, 0.05f);
+    
+    autoGain.prepare(sampleRate);
+    
+    // start from the current settings instead of ramping in from the defaults
+    updateParameters();
+    for (auto* smoother : { &inputDB, &driveDB, &sideDriveDB, &bias, &dcBlock, &mix, &outputDB, &cabMix })
+        smoother->setCurrentAndTargetValue(smoother->getTargetValue());
+    
+    gainRamps.setSize(7, samplesPerBlock);
+    shaper.prepare(sampleRate, samplesPerBlock);
+    diodeTable = sharedResources->getDiodeTable(sampleRate);
+    
+    cabinet.prepare({ sampleRate, (juce::uint32) samplesPerBlock, (juce::uint32) getTotalNumOutputChannels() });
+    cabBuffer.setSize(getTotalNumOutputChannels(), samplesPerBlock);
+    cabActive = false;
+    
+    bypassFade.reset(sampleRate, 0.02f);
+    bypassFade.setCurrentAndTargetValue(bypassParam->load() > 0.5f ? 0.0f : 1.0f);
+    fullyBypassed = false;
+    bypassDryBuffer.setSize(getTotalNumOutputChannels(), samplesPerBlock);
 }
 
 void Dist0322AudioProcessor::releaseResources()
@@ -147,6 +180,17 @@ bool Dist0322AudioProcessor::isBusesLayoutSupported (const BusesLayout& layouts)
 #endif
 
 void Dist0322AudioProcessor::processBlock (juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages)
+{
+    // hosts that use our bypass parameter keep calling processBlock
+    processWithBypass(buffer, bypassParam->load() > 0.5f);
+}
+
+void Dist0322AudioProcessor::processBlockBypassed (juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages)
+{
+    processWithBypass(buffer, true);
+}
+
+void Dist0322AudioProcessor::processWithBypass (juce::AudioBuffer<float>& buffer, bool bypassed)
 {
     juce::ScopedNoDenormals noDenormals;
     auto totalNumInputChannels  = getTotalNumInputChannels();
@@ -156,34 +200,187 @@ void Dist0322AudioProcessor::processBlock (juce::AudioBuffer<float>& buffer, juc
     for (auto i = totalNumInputChannels; i < totalNumOutputChannels; ++i)
         buffer.clear (i, 0, buffer.getNumSamples());
 
-   
-    for (int channel = 0; channel < totalNumInputChannels; ++channel)
+    bypassFade.setTargetValue(bypassed ? 0.0f : 1.0f);
+    
+    // fully bypassed: the input is the output, no DSP and no scope work. There is no
+    // latency anywhere in the chain, so the dry signal needs no delay to line up.
+    if (bypassed && ! bypassFade.isSmoothing())
+    {
+        fullyBypassed = true;
+        return;
+    }
+    
+    // coming back: start from the current settings and empty filter state, not from
+    // whatever was left when the bypass engaged
+    if (fullyBypassed)
     {
+        fullyBypassed = false;
+        autoGain.reset();
+        updateParameters();
+        for (auto* smoother : { &inputDB, &driveDB, &sideDriveDB, &bias, &dcBlock, &mix, &outputDB, &cabMix })
+            smoother->setCurrentAndTargetValue(smoother->getTargetValue());
+        shaper.reset();
+        cabActive = false;
+    }
+    
+    if (! bypassFade.isSmoothing())
+    {
+        processDsp(buffer, totalNumInputChannels);
+    }
+    else
+    {
+        // engaging or releasing: crossfade the processed signal against the dry one, in
+        // chunks that fit bypassDryBuffer in case the host sends more than it announced
+        const auto maxChunk = juce::jmax(1, bypassDryBuffer.getNumSamples());
         
-        for (int sample{0}; sample < buffer.getNumSamples(); ++sample)
+        for (int start = 0; start < buffer.getNumSamples(); start += maxChunk)
         {
-           
-            auto* channelData = buffer.getWritePointer (channel);
-            const auto input = channelData[sample] * juce::Decibels::decibelsToGain(inputDB.getNextValue());
-           // const auto inputDry = channelData[sample];
-            
-            // arctan distortion = soft clipping
-            const auto softClip = piDiv * std::atanf(input * juce::Decibels::decibelsToGain(driveDB.getNextValue()));
+            const auto numSamples = juce::jmin(maxChunk, buffer.getNumSamples() - start);
+            juce::AudioBuffer<float> chunk (buffer.getArrayOfWritePointers(), totalNumInputChannels, start, numSamples);
             
-            auto blend = input * (1.0 - mix.getNextValue()) + softClip * mix.getNextValue();
+            for (int channel = 0; channel < totalNumInputChannels; ++channel)
+                bypassDryBuffer.copyFrom(channel, 0, chunk, channel, 0, numSamples);
             
-            blend *= juce::Decibels::decibelsToGain(outputDB.getNextValue());
+            processDsp(chunk, totalNumInputChannels);
             
-            channelData[sample] = blend;
-       
+            for (int i = 0; i < numSamples; ++i)
+            {
+                const auto amount = bypassFade.getNextValue();
+                for (int channel = 0; channel < totalNumInputChannels; ++channel)
+                {
+                    const auto dry = bypassDryBuffer.getSample(channel, i);
+                    auto* out = chunk.getWritePointer(channel);
+                    out[i] = dry + (out[i] - dry) * amount;
+                }
+            }
         }
     }
+    
     //Oscilloscope
     scopeDataCollector.process(buffer.getReadPointer(0), (size_t)buffer.getNumSamples());
+    
+    //Goniometer, a mono layout shows up as a vertical line
+    const auto* left = buffer.getReadPointer(0);
+    const auto* right = buffer.getReadPointer(totalNumInputChannels > 1 ? 1 : 0);
+    stereoDataQueue.push(left, right, (size_t)buffer.getNumSamples());
+    correlationMeter.process(left, right, (size_t)buffer.getNumSamples());
   
    // std::cout << ((size_t)buffer.getNumSamples());
 }
 
+void Dist0322AudioProcessor::processDsp (juce::AudioBuffer<float>& buffer, int totalNumInputChannels)
+{
+    updateParameters();
+    if (autoGainOn)
+        autoGain.measureInput(buffer.getArrayOfReadPointers(), totalNumInputChannels, buffer.getNumSamples());
+    
+    const auto maxChunk = juce::jmax(1, gainRamps.getNumSamples());
+    auto outputGainPower = 0.0f;
+
+    // some hosts send bigger blocks than announced, so walk the buffer in ramp sized chunks
+    for (int start = 0; start < buffer.getNumSamples(); start += maxChunk)
+    {
+        const auto numSamples = juce::jmin(maxChunk, buffer.getNumSamples() - start);
+        fillGainRamps(numSamples);
+        
+        const ShaperGains gains { gainRamps.getReadPointer(0), gainRamps.getReadPointer(1),
+                                  gainRamps.getReadPointer(2), gainRamps.getReadPointer(3),
+                                  gainRamps.getReadPointer(4), gainRamps.getReadPointer(5),
+                                  gainRamps.getReadPointer(6), diodeTable.get() };
+        
+        for (int channel = 0; channel < totalNumInputChannels; channel += 2)
+        {
+            auto* left = buffer.getWritePointer (channel, start);
+            auto* right = channel + 1 < totalNumInputChannels ? buffer.getWritePointer (channel + 1, start) : nullptr;
+            
+            // arctan or diode distortion = soft clipping
+            shaper.process(stereoMode, clipperType, left, right, gains, numSamples);
+        }
+        
+        if (autoGainOn)
+            outputGainPower += AutoGain::meanSquare(&gains.output, 1, numSamples) * (float) numSamples;
+    }
+    //Cabinet IR, costs nothing while it is off
+    if (cabMix.isSmoothing() || cabMix.getTargetValue() > 0.0f)
+    {
+        processCabinet(buffer, totalNumInputChannels);
+        
+        // a new IR only becomes current inside process(), tell the host about the new tail
+        const auto irSize = (int) cabinet.getCurrentIRSize();
+        if (irLength.exchange(irSize) != irSize)
+            triggerAsyncUpdate();
+    }
+    else
+        cabActive = false;
+    
+    if (autoGainOn)
+        autoGain.measureOutput(buffer.getArrayOfReadPointers(), totalNumInputChannels, buffer.getNumSamples(), outputGainPower / (float) buffer.getNumSamples());
+}
+
+void Dist0322AudioProcessor::processCabinet (juce::AudioBuffer<float>& buffer, int numChannels)
+{
+    // don't let the tail from the last time it was on leak into the fade in
+    if (! cabActive)
+        cabinet.reset();
+    cabActive = true;
+    
+    juce::dsp::AudioBlock<float> block (buffer.getArrayOfWritePointers(), (size_t) numChannels, (size_t) buffer.getNumSamples());
+    
+    if (! cabMix.isSmoothing())
+    {
+        cabinet.process(juce::dsp::ProcessContextReplacing<float> (block));
+        return;
+    }
+    
+    // switching on or off: convolve into cabBuffer and crossfade against the dry signal
+    const auto maxChunk = juce::jmax(1, cabBuffer.getNumSamples());
+    
+    for (int start = 0; start < buffer.getNumSamples(); start += maxChunk)
+    {
+        const auto numSamples = juce::jmin(maxChunk, buffer.getNumSamples() - start);
+        auto dry = block.getSubBlock((size_t) start, (size_t) numSamples);
+        juce::dsp::AudioBlock<float> wet (cabBuffer.getArrayOfWritePointers(), (size_t) numChannels, (size_t) numSamples);
+        cabinet.process(juce::dsp::ProcessContextNonReplacing<float> (dry, wet));
+        
+        for (int i = 0; i < numSamples; ++i)
+        {
+            const auto amount = cabMix.getNextValue();
+            for (int channel = 0; channel < numChannels; ++channel)
+            {
+                auto* out = buffer.getWritePointer(channel, start);
+                out[i] += (cabBuffer.getSample(channel, i) - out[i]) * amount;
+            }
+        }
+    }
+}
+
+void Dist0322AudioProcessor::fillGainRamps (int numSamples)
+{
+    // advance every smoother once per sample, the result is shared by all channels
+    auto fill = [numSamples] (juce::LinearSmoothedValue<float>& smoother, float* dest, bool isDecibels)
+    {
+        if (! smoother.isSmoothing())
+        {
+            const auto value = smoother.getTargetValue();
+            juce::FloatVectorOperations::fill(dest, isDecibels ? juce::Decibels::decibelsToGain(value) : value, numSamples);
+            return;
+        }
+        
+        for (int i = 0; i < numSamples; ++i)
+        {
+            const auto value = smoother.getNextValue();
+            dest[i] = isDecibels ? juce::Decibels::decibelsToGain(value) : value;
+        }
+    };
+    
+    fill(inputDB, gainRamps.getWritePointer(0), true);
+    fill(driveDB, gainRamps.getWritePointer(1), true);
+    fill(sideDriveDB, gainRamps.getWritePointer(2), true);
+    fill(bias, gainRamps.getWritePointer(3), false);
+    fill(dcBlock, gainRamps.getWritePointer(4), false);
+    fill(mix, gainRamps.getWritePointer(5), false);
+    fill(outputDB, gainRamps.getWritePointer(6), true);
+}
 
 //==============================================================================
 bool Dist0322AudioProcessor::hasEditor() const
@@ -219,6 +416,13 @@ void Dist0322AudioProcessor::setStateInformation (const void* data, int sizeInBy
            if (xmlState.get() != nullptr)
                if (xmlState->hasTagName (apvts.state.getType()))
                    apvts.replaceState (juce::ValueTree::fromXml (*xmlState));
+    
+    // a state without a usable IR must not keep playing through the previous one, the
+    // cabinet fades out and stays off until an IR is loaded again
+    const auto irFile = getImpulseResponseFile();
+    if (irFile.existsAsFile())
+        cabinet.loadImpulseResponse(irFile, juce::dsp::Convolution::Stereo::yes, juce::dsp::Convolution::Trim::yes, 0);
+    hasImpulseResponse = irFile.existsAsFile();
 
 }
 
@@ -235,31 +439,76 @@ juce::AudioProcessorValueTreeState::ParameterLayout Dist0322AudioProcessor::crea
     
     params.push_back(std::make_unique<juce::AudioParameterInt>("DRIVE", "Drive", 0, 15, 0));
     
+    params.push_back(std::make_unique<juce::AudioParameterInt>("SIDE", "Side Drive", 0, 15, 0));
+    
+    params.push_back(std::make_unique<juce::AudioParameterInt>("BIAS", "Bias", 0, 100, 0));
+    
+    params.push_back(std::make_unique<juce::AudioParameterChoice>("STEREO", "Stereo", juce::StringArray { "L/R", "M/S", "Linked" }, 0));
+    
+    params.push_back(std::make_unique<juce::AudioParameterChoice>("CLIPPER", "Clipper", juce::StringArray { "Arctan", "Diode" }, 0));
+    
     params.push_back(std::make_unique<juce::AudioParameterInt>("MIX", "Mix", 0, 100,0));
     
     params.push_back(std::make_unique<juce::AudioParameterInt>("OUTPUT", "Output", -30, 12, 0));
     
+    params.push_back(std::make_unique<juce::AudioParameterBool>("AUTOGAIN", "Auto Gain", false));
+    
+    params.push_back(std::make_unique<juce::AudioParameterBool>("CAB", "Cabinet", false));
+    
+    params.push_back(std::make_unique<juce::AudioParameterBool>("BYPASS", "Bypass", false));
+    
     return {params.begin(), params.end()};
 }
 
-void Dist0322AudioProcessor::parameterChanged(const juce::String& parameterID, float newValue)
+void Dist0322AudioProcessor::updateParameters()
 {
-    if (parameterID == "INPUT")
-    {
-        inputDB.setTargetValue(newValue);
-    }
-    if (parameterID == "OUTPUT")
-    {
-        outputDB.setTargetValue(newValue);
-    }
-    if (parameterID == "DRIVE")
-    {
-        driveDB.setTargetValue(newValue);
-    }
-    if (parameterID == "MIX")
-    {
-        mix.setTargetValue(newValue/100);
-    }
+    inputDB.setTargetValue(inputParam->load());
+    driveDB.setTargetValue(driveParam->load());
+    sideDriveDB.setTargetValue(sideParam->load());
+    // full scale bias shifts the shaper input by half of 0 dBFS
+    bias.setTargetValue(biasParam->load()/200);
+    // the DC blocker is only needed while there is a bias to remove
+    dcBlock.setTargetValue(biasParam->load() != 0.0f ? 1.0f : 0.0f);
+    mix.setTargetValue(mixParam->load()/100);
+    
+    // auto gain keeps OUTPUT as a trim on top of the loudness correction
+    const auto autoGainWasOn = autoGainOn;
+    autoGainOn = autoGainParam->load() > 0.5f;
+    if (autoGainOn && ! autoGainWasOn)
+        autoGain.reset();
+    outputDB.setTargetValue(outputParam->load() + (autoGainOn ? autoGain.getCorrectionDB() : 0.0f));
+    stereoMode = (StereoMode) juce::roundToInt(stereoParam->load());
+    clipperType = (ClipperType) juce::roundToInt(clipperParam->load());
+    
+    // the reported tail follows CAB
+    const auto cabTarget = cabParam->load() > 0.5f && hasImpulseResponse.load() ? 1.0f : 0.0f;
+    if (cabTarget != cabMix.getTargetValue())
+        triggerAsyncUpdate();
+    cabMix.setTargetValue(cabTarget);
+}
+
+void Dist0322AudioProcessor::loadImpulseResponse (const juce::File& file)
+{
+    cabinet.loadImpulseResponse(file, juce::dsp::Convolution::Stereo::yes, juce::dsp::Convolution::Trim::yes, 0);
+    apvts.state.setProperty("IRPATH", file.getFullPathName(), nullptr);
+    hasImpulseResponse = true;
+}
+
+void Dist0322AudioProcessor::handleAsyncUpdate()
+{
+    // the host asks for the tail again
+    updateHostDisplay();
+}
+
+juce::AudioProcessorParameter* Dist0322AudioProcessor::getBypassParameter() const
+{
+    return apvts.getParameter("BYPASS");
+}
+
+juce::File Dist0322AudioProcessor::getImpulseResponseFile() const
+{
+    const auto path = apvts.state.getProperty("IRPATH").toString();
+    return path.isNotEmpty() ? juce::File(path) : juce::File();
 }
 
 juce::AudioProcessor* JUCE_CALLTYPE createPluginFilter()
@@ -10,11 +10,16 @@
 
 #include <JuceHeader.h>
 #include "Oschilloscope.h"
+#include "Goniometer.h"
+#include "Shaper.h"
+#include "AutoGain.h"
+#include "SharedResources.h"
 //#include "Visualiser.h"
 //==============================================================================
 /**
 */
-class Dist0322AudioProcessor  : public juce::AudioProcessor, juce::AudioProcessorValueTreeState::Listener
+class Dist0322AudioProcessor  : public juce::AudioProcessor,
+                                private juce::AsyncUpdater
 {
 public:
     //==============================================================================
@@ -30,6 +35,8 @@ public:
    #endif
 
     void processBlock (juce::AudioBuffer<float>&, juce::MidiBuffer&) override;
+    void processBlockBypassed (juce::AudioBuffer<float>&, juce::MidiBuffer&) override;
+    juce::AudioProcessorParameter* getBypassParameter() const override;
 
     //==============================================================================
     juce::AudioProcessorEditor* createEditor() override;
@@ -56,24 +63,77 @@ public:
     
     juce::LinearSmoothedValue<float> inputDB {0.01};
     juce::LinearSmoothedValue<float> driveDB {0.01};
+    juce::LinearSmoothedValue<float> sideDriveDB {0.01};
+    juce::LinearSmoothedValue<float> bias {0.0};
+    juce::LinearSmoothedValue<float> dcBlock {0.0};
     juce::LinearSmoothedValue<float> outputDB {0.01};
     juce::LinearSmoothedValue<float> mix {0.01};
     // apvts Object
     juce::AudioProcessorValueTreeState apvts;
     
     AudioBufferQueue<float> & getAudioBufferQueue() { return scopeDataQueue; }
+    StereoBufferQueue<float> & getStereoBufferQueue() { return stereoDataQueue; }
+    const CorrelationMeter<float> & getCorrelationMeter() const { return correlationMeter; }
     
-    void parameterChanged (const juce::String& parameterID, float newValue) override;
+    // loads and resamples on a background thread, the swap is crossfaded on the audio thread
+    void loadImpulseResponse (const juce::File& file);
+    juce::File getImpulseResponseFile() const;
     
    
 private:
+    void processWithBypass (juce::AudioBuffer<float>& buffer, bool bypassed);
+    void processDsp (juce::AudioBuffer<float>& buffer, int totalNumInputChannels);
+    void updateParameters();
+    void fillGainRamps (int numSamples);
+    void processCabinet (juce::AudioBuffer<float>& buffer, int numChannels);
+    void handleAsyncUpdate() override;
+
     AudioBufferQueue<float> scopeDataQueue;
     ScopeDataCollector<float> scopeDataCollector;
+    StereoBufferQueue<float> stereoDataQueue;
+    CorrelationMeter<float> correlationMeter;
     // apvts Function
     juce::AudioProcessorValueTreeState::ParameterLayout createParameters();
     
   
+    // per-sample gains for the current block, one channel per smoother
+    juce::AudioBuffer<float> gainRamps;
+    Shaper shaper;
+    ClipperType clipperType = ClipperType::arctan;
+    juce::SharedResourcePointer<SharedResources> sharedResources;
+    std::shared_ptr<const DiodeTable> diodeTable;
+    AutoGain autoGain;
+    bool autoGainOn = false;
+    
+    // cabinet IR after the shaper, zero latency head partition. IRs load on the shared
+    // queue, declared after sharedResources so the queue outlives the cabinet
+    juce::dsp::Convolution cabinet { juce::dsp::Convolution::NonUniform { 256 }, sharedResources->convolutionQueue };
+    juce::LinearSmoothedValue<float> cabMix {0.0};
+    juce::AudioBuffer<float> cabBuffer;
+    bool cabActive = false;
+    // IR length in samples, published by the audio thread for getTailLengthSeconds
+    std::atomic<int> irLength { 0 };
+    // false until an IR is loaded, and again after restoring a state without a usable one
+    std::atomic<bool> hasImpulseResponse { false };
+    
+    // 1 = processing, 0 = bypassed; nothing runs once it has settled at 0
+    juce::LinearSmoothedValue<float> bypassFade {1.0};
+    juce::AudioBuffer<float> bypassDryBuffer;
+    bool fullyBypassed = false;
+    StereoMode stereoMode = StereoMode::leftRight;
+    
+    // raw parameter values, only read on the audio thread
+    std::atomic<float>* inputParam = nullptr;
+    std::atomic<float>* driveParam = nullptr;
+    std::atomic<float>* sideParam = nullptr;
+    std::atomic<float>* biasParam = nullptr;
+    std::atomic<float>* stereoParam = nullptr;
+    std::atomic<float>* clipperParam = nullptr;
+    std::atomic<float>* mixParam = nullptr;
+    std::atomic<float>* outputParam = nullptr;
+    std::atomic<float>* autoGainParam = nullptr;
+    std::atomic<float>* cabParam = nullptr;
+    std::atomic<float>* bypassParam = nullptr;
     //==============================================================================
-    const float piDiv = 2.0/ juce::MathConstants<float>::pi;
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (Dist0322AudioProcessor)
 };
@@ -0,0 +1,192 @@
+#pragma once
+#include "Stages.h"
+#include <type_traits>
+#include <vector>
+
+// How the two channels of a stereo buffer are fed to the clipper.
+enum class StereoMode
+{
+    leftRight = 0,
+    midSide,
+    linked
+};
+
+// The curve in the clipper stage.
+enum class ClipperType
+{
+    arctan = 0,
+    diode
+};
+
+// The clipper signal paths, one fused Chain per stereo mode. The stereo mode is picked
+// once per block and every mode walks the buffer once: for M/S the encode and decode
+// are stages of the same loop, and BIAS leaves DC on the wet signal that a DC blocker
+// stage removes before the mix. Changing the stereo mode or clipper crossfades from the
+// old path to the new one, so automating either doesn't step.
+class Shaper
+{
+public:
+    static constexpr double switchTime = 0.02;
+
+    void prepare (double sampleRate, int maximumBlockSize)
+    {
+        mono.prepare (sampleRate);
+        leftRight.prepare (sampleRate);
+        midSide.prepare (sampleRate);
+        linked.prepare (sampleRate);
+        diodeMono.prepare (sampleRate);
+        diodeLeftRight.prepare (sampleRate);
+        diodeMidSide.prepare (sampleRate);
+
+        fadeLength = std::max (1, (int) (sampleRate * switchTime));
+        for (auto& channel : scratch)
+            channel.assign ((size_t) std::max (1, maximumBlockSize), 0.0f);
+        reset();
+    }
+
+    void reset()
+    {
+        mono.reset();
+        leftRight.reset();
+        midSide.reset();
+        linked.reset();
+        diodeMono.reset();
+        diodeLeftRight.reset();
+        diodeMidSide.reset();
+        fadeRemaining = 0;
+        hasPath = false;
+    }
+
+    // The diode has a state per lane and no shared gain to link, so Linked with the
+    // diode runs the L/R path.
+    void process (StereoMode mode, ClipperType clipper, float* left, float* right, const ShaperGains& g, int numSamples)
+    {
+        const auto numLanes = right == nullptr ? 1 : 2;
+        if (numLanes == 1 || (clipper == ClipperType::diode && mode == StereoMode::linked))
+            mode = StereoMode::leftRight;
+
+        const Path requested { mode, clipper };
+        if (! hasPath)
+        {
+            current = requested;
+            hasPath = true;
+        }
+
+        // The new path starts from empty filter state, it was last used long ago. A change
+        // that arrives during a fade waits until that fade has finished.
+        if (fadeRemaining == 0 && ! (requested == current))
+        {
+            previous = current;
+            current = requested;
+            visit (current, numLanes, [] (auto& chain, auto) { chain.reset(); });
+            fadeRemaining = fadeLength;
+        }
+
+        // the old path renders into scratch, chunked in case a block is bigger than announced
+        const auto maxChunk = (int) scratch[0].size();
+
+        for (int start = 0; start < numSamples; start += maxChunk)
+        {
+            const auto n = std::min (maxChunk, numSamples - start);
+            const auto gains = advance (g, start);
+            float* channels[] = { left + start, right != nullptr ? right + start : nullptr };
+
+            if (fadeRemaining == 0)
+            {
+                run (current, channels, numLanes, gains, n);
+                continue;
+            }
+
+            float* old[] = { scratch[0].data(), scratch[1].data() };
+            for (int k = 0; k < numLanes; ++k)
+                std::copy (channels[k], channels[k] + n, old[k]);
+
+            run (previous, old, numLanes, gains, n);
+            run (current, channels, numLanes, gains, n);
+
+            for (int i = 0; i < n; ++i)
+            {
+                const auto amount = fadeRemaining > 0 ? 1.0f - (float) fadeRemaining-- / (float) fadeLength : 1.0f;
+                for (int k = 0; k < numLanes; ++k)
+                    channels[k][i] = old[k][i] + (channels[k][i] - old[k][i]) * amount;
+            }
+        }
+    }
+
+private:
+    struct Path
+    {
+        StereoMode mode;
+        ClipperType clipper;
+
+        bool operator== (const Path& other) const { return mode == other.mode && clipper == other.clipper; }
+    };
+
+    // calls function with the chain for a path and its lane count as an integral_constant
+    template <typename Function>
+    void visit (const Path& path, int numLanes, Function&& function)
+    {
+        using Mono = std::integral_constant<size_t, 1>;
+        using Stereo = std::integral_constant<size_t, 2>;
+        const auto diode = path.clipper == ClipperType::diode;
+
+        if (numLanes == 1)
+        {
+            if (diode)
+                function (diodeMono, Mono());
+            else
+                function (mono, Mono());
+        }
+        else if (diode)
+        {
+            if (path.mode == StereoMode::midSide)
+                function (diodeMidSide, Stereo());
+            else
+                function (diodeLeftRight, Stereo());
+        }
+        else if (path.mode == StereoMode::midSide)
+            function (midSide, Stereo());
+        else if (path.mode == StereoMode::linked)
+            function (linked, Stereo());
+        else
+            function (leftRight, Stereo());
+    }
+
+    void run (const Path& path, float* const* channels, int numLanes, const ShaperGains& g, int numSamples)
+    {
+        visit (path, numLanes, [&] (auto& chain, auto lanes) { chain.template run<decltype (lanes)::value> (channels, g, numSamples); });
+    }
+
+    static ShaperGains advance (const ShaperGains& g, int offset)
+    {
+        return { g.input + offset, g.drive + offset, g.sideDrive + offset, g.bias + offset,
+                 g.dcBlock + offset, g.mix + offset, g.output + offset, g.diodeTable };
+    }
+
+    template <template <bool> class Clipper>
+    using LeftRightChain = Chain<Stage::InputGain, Stage::CaptureDry, Stage::Bias, Clipper<false>,
+                                 Stage::DCBlock, Stage::Mix, Stage::OutputGain>;
+
+    // Mid is clipped with DRIVE, side with SIDE. The mix is linear, so blending
+    // in the M/S domain is the same as blending after the decode.
+    template <template <bool> class Clipper>
+    using MidSideChain = Chain<Stage::InputGain, Stage::MidSideEncode, Stage::CaptureDry, Stage::Bias,
+                               Clipper<true>, Stage::DCBlock, Stage::Mix, Stage::OutputGain,
+                               Stage::MidSideDecode>;
+
+    using LinkedChain = Chain<Stage::InputGain, Stage::CaptureDry, Stage::Bias, Stage::LinkedArctan,
+                              Stage::DCBlock, Stage::Mix, Stage::OutputGain>;
+
+    LeftRightChain<Stage::Arctan> mono, leftRight;
+    MidSideChain<Stage::Arctan> midSide;
+    LinkedChain linked;
+    LeftRightChain<Stage::Diode> diodeMono, diodeLeftRight;
+    MidSideChain<Stage::Diode> diodeMidSide;
+
+    Path current { StereoMode::leftRight, ClipperType::arctan };
+    Path previous { StereoMode::leftRight, ClipperType::arctan };
+    bool hasPath = false;
+    int fadeLength = 1;
+    int fadeRemaining = 0;
+    std::vector<float> scratch[2];
+};
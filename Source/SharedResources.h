@@ -0,0 +1,43 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "CustomLookAndFeel.h"
+#include "Stages.h"
+
+// Read-only data shared by every plugin instance in the host process. Reach it through
+// juce::SharedResourcePointer<SharedResources>: it is built by the first instance and freed
+// with the last one. Only immutable data and thread-safe services belong here, anything an
+// instance writes stays in that instance.
+class SharedResources
+{
+public:
+    SharedResources() = default;
+    
+    // look and feel for every Knob, its drawing state is set once in the constructor
+    CustomDial dialLookAndFeel;
+
+    // one background thread that loads impulse responses for every cabinet, instead of a
+    // thread per instance
+    juce::dsp::ConvolutionMessageQueue convolutionQueue;
+
+    // diode solution for a sample rate, built by the first instance that asks for it.
+    // Call from prepareToPlay, never from the audio thread.
+    std::shared_ptr<const DiodeTable> getDiodeTable (double sampleRate)
+    {
+        const juce::ScopedLock sl (lock);
+        
+        for (auto& table : diodeTables)
+            if (table->getSampleRate() == sampleRate)
+                return table;
+        
+        diodeTables.push_back (std::make_shared<const DiodeTable> (sampleRate));
+        return diodeTables.back();
+    }
+    
+private:
+    juce::CriticalSection lock;
+    std::vector<std::shared_ptr<const DiodeTable>> diodeTables;
+    
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (SharedResources)
+};
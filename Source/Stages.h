@@ -0,0 +1,406 @@
+#pragma once
+#include <cmath>
+#include <cstddef>
+#include <algorithm>
+#include <vector>
+
+class DiodeTable;
+
+// Per-sample linear gains for one block. They are filled once from the smoothers
+// and shared by every channel, so all channels see the same parameter ramp.
+struct ShaperGains
+{
+    const float* input;
+    const float* drive;
+    const float* sideDrive;
+    const float* bias;
+    const float* dcBlock;
+    const float* mix;
+    const float* output;
+    
+    // immutable diode solution for the current sample rate, shared between instances
+    const DiodeTable* diodeTable;
+};
+
+//==============================================================================
+// RC low pass into a pair of antiparallel diodes: C dv/dt = (vin - v) / R - 2 Is sinh(v / Vt).
+// With the trapezoidal rule every sample has to solve
+//     v + h (v / R + 2 Is sinh(v / Vt)) = rhs,    h = T / 2C
+// where rhs only depends on the past and the new input. The left side is monotonic in v,
+// so its inverse is tabulated once per sample rate, and the realtime side is a lookup plus
+// a fixed number of Newton-Raphson refinements.
+class DiodeTable
+{
+public:
+    static constexpr float resistance = 2200.0f;
+    static constexpr float capacitance = 10.0e-9f;
+    static constexpr float saturationCurrent = 2.52e-9f;
+    static constexpr float thermalVoltage = 0.0453f;
+    static constexpr float rhsLimit = 64.0f;
+    static constexpr int size = 4096;
+
+    explicit DiodeTable (double rate)
+        : sampleRate (rate), h ((float) (0.5 / (rate * capacitance))), solution ((size_t) size + 1)
+    {
+        // offline, so plain bisection is fine
+        for (int i = 0; i <= size; ++i)
+        {
+            const auto rhs = -(double) rhsLimit + 2.0 * rhsLimit * i / size;
+            double low = -2.0, high = 2.0;
+
+            for (int k = 0; k < 64; ++k)
+            {
+                const auto v = 0.5 * (low + high);
+                if (residual (v) < rhs)
+                    low = v;
+                else
+                    high = v;
+            }
+            solution[(size_t) i] = (float) (0.5 * (low + high));
+        }
+    }
+
+    double getSampleRate() const { return sampleRate; }
+    float getH() const { return h; }
+
+    inline float lookup (float rhs) const
+    {
+        const auto position = (std::min (std::max (rhs, -rhsLimit), rhsLimit) + rhsLimit) * ((float) size / (2.0f * rhsLimit));
+        const auto index = std::min ((int) position, size - 1);
+        const auto frac = position - (float) index;
+        return solution[(size_t) index] + (solution[(size_t) index + 1] - solution[(size_t) index]) * frac;
+    }
+
+private:
+    double residual (double v) const
+    {
+        return v + h * (v / resistance + 2.0 * saturationCurrent * std::sinh (v / thermalVoltage));
+    }
+
+    double sampleRate;
+    float h;
+    std::vector<float> solution;
+};
+
+// One sample of every lane as it travels down a Chain. The lanes are L/R, or M/S
+// between the encode and decode stages. dry holds the signal the mix blends back in.
+template <size_t numLanes>
+struct Frame
+{
+    float lane[numLanes];
+    float dry[numLanes];
+};
+
+//==============================================================================
+// Stages are small policy types with prepare(), reset() and an inline process() that
+// works on one Frame. Chain strings them together at compile time so a whole signal
+// path is a single loop over the buffer, and the compiler sees every stage at once.
+namespace Stage
+{
+    struct InputGain
+    {
+        void prepare (double) {}
+        void reset() {}
+
+        template <size_t n>
+        inline void process (Frame<n>& f, const ShaperGains& g, int i)
+        {
+            for (size_t k = 0; k < n; ++k)
+                f.lane[k] *= g.input[i];
+        }
+    };
+
+    struct MidSideEncode
+    {
+        void prepare (double) {}
+        void reset() {}
+
+        inline void process (Frame<2>& f, const ShaperGains&, int)
+        {
+            const auto mid  = (f.lane[0] + f.lane[1]) * 0.5f;
+            const auto side = (f.lane[0] - f.lane[1]) * 0.5f;
+            f.lane[0] = mid;
+            f.lane[1] = side;
+        }
+    };
+
+    struct MidSideDecode
+    {
+        void prepare (double) {}
+        void reset() {}
+
+        inline void process (Frame<2>& f, const ShaperGains&, int)
+        {
+            const auto left  = f.lane[0] + f.lane[1];
+            const auto right = f.lane[0] - f.lane[1];
+            f.lane[0] = left;
+            f.lane[1] = right;
+        }
+    };
+
+    // remembers the signal at this point for Mix
+    struct CaptureDry
+    {
+        void prepare (double) {}
+        void reset() {}
+
+        template <size_t n>
+        inline void process (Frame<n>& f, const ShaperGains&, int)
+        {
+            for (size_t k = 0; k < n; ++k)
+                f.dry[k] = f.lane[k];
+        }
+    };
+
+    // BIAS offsets the signal before the clipper for even harmonics
+    struct Bias
+    {
+        void prepare (double) {}
+        void reset() {}
+
+        template <size_t n>
+        inline void process (Frame<n>& f, const ShaperGains& g, int i)
+        {
+            for (size_t k = 0; k < n; ++k)
+                f.lane[k] += g.bias[i];
+        }
+    };
+
+    // Arctan soft clipper. With useSideDrive the second lane (side) is driven by SIDE.
+    template <bool useSideDrive>
+    struct Arctan
+    {
+        static constexpr float piDiv = 2.0f / 3.14159265358979323846f;
+
+        // Any faster variant (table, approximation, vectorised) has to pass
+        // Tests/KernelTests.cpp, which holds it to a scalar std::atan reference.
+        static inline float arctan (float x) { return piDiv * std::atan (x); }
+
+        void prepare (double) {}
+        void reset() {}
+
+        template <size_t n>
+        inline void process (Frame<n>& f, const ShaperGains& g, int i)
+        {
+            for (size_t k = 0; k < n; ++k)
+                f.lane[k] = arctan (f.lane[k] * (useSideDrive && k == 1 ? g.sideDrive[i] : g.drive[i]));
+        }
+    };
+
+    // Both lanes share one gain, so the stereo image is kept. The gain is the Arctan curve
+    // at the level of a peak envelope of the louder lane, not at the sample itself: a gain
+    // that follows every sample would modulate one lane with the other at audio rate.
+    // Attack is instant, so no peak gets past the curve, and the release is slow enough
+    // to hold over a cycle of the lowest notes. Like DCBlock the coefficient is within 1e-4
+    // of 1, so the envelope runs in double.
+    struct LinkedArctan
+    {
+        static constexpr double release = 0.1;
+
+        void prepare (double sampleRate)
+        {
+            releaseCoeff = std::exp (-1.0 / (release * sampleRate));
+            reset();
+        }
+
+        void reset() { envelope = 0.0; }
+
+        inline void process (Frame<2>& f, const ShaperGains& g, int i)
+        {
+            const double peak = std::max (std::abs (f.lane[0]), std::abs (f.lane[1]));
+            envelope = std::max (peak, envelope * releaseCoeff);
+
+            const auto level = (float) envelope * g.drive[i];
+            const auto shared = level > 1.0e-9f ? Arctan<false>::arctan (level) / level : Arctan<false>::piDiv;
+            const auto wet = shared * g.drive[i];
+            f.lane[0] *= wet;
+            f.lane[1] *= wet;
+        }
+
+        double releaseCoeff = 0.0;
+        double envelope = 0.0;
+    };
+
+    // Diode clipper from DiodeTable, the RC makes the clipping frequency dependent. Drive
+    // and output are scaled so small signals and full clipping line up with Arctan.
+    template <bool useSideDrive>
+    struct Diode
+    {
+        static constexpr float clipVoltage = 0.7f;
+        static constexpr int refinements = 1;
+
+        void prepare (double) { reset(); }
+
+        void reset()
+        {
+            for (size_t k = 0; k < 2; ++k)
+                v[k] = current[k] = 0.0f;
+        }
+
+        template <size_t n>
+        inline void process (Frame<n>& f, const ShaperGains& g, int i)
+        {
+            const auto* table = g.diodeTable;
+            if (table == nullptr)
+                return;
+
+            constexpr auto r = DiodeTable::resistance;
+            constexpr auto is = DiodeTable::saturationCurrent;
+            constexpr auto vt = DiodeTable::thermalVoltage;
+            const auto h = table->getH();
+
+            for (size_t k = 0; k < n; ++k)
+            {
+                const auto drive = useSideDrive && k == 1 ? g.sideDrive[i] : g.drive[i];
+                const auto vin = f.lane[k] * drive * Arctan<false>::piDiv * clipVoltage;
+                // Far beyond full scale the solution only grows logarithmically, but one
+                // Newton step from the edge of the table would overshoot into exp() overflow.
+                // Holding rhs at the table range keeps the state physical and the output bounded.
+                const auto rhs = std::min (std::max (v[k] + h * (current[k] + vin / r), -DiodeTable::rhsLimit), DiodeTable::rhsLimit);
+
+                // the table is already close, refinements bound the work per sample
+                auto x = table->lookup (rhs);
+                for (int it = 0; it < refinements; ++it)
+                {
+                    const auto e = std::exp (x / vt);
+                    const auto ie = 1.0f / e;
+                    const auto residual = x + h * (x / r + is * (e - ie)) - rhs;
+                    const auto slope = 1.0f + h * (1.0f / r + is / vt * (e + ie));
+                    x -= residual / slope;
+                }
+
+                // capacitor current at the new point, read back from the solved equation
+                current[k] = vin / r + (x - rhs) / h;
+                v[k] = x;
+                f.lane[k] = x / clipVoltage;
+            }
+        }
+
+        float v[2] = {};
+        float current[2] = {};
+    };
+
+    // One pole DC blocker, y[n] = x[n] - x[n-1] + R * y[n-1], for the offset BIAS leaves
+    // behind. The state is double: R is within 1e-3 of 1 and float feedback leaves a
+    // rounding floor well above what the clipper itself adds. The filter always runs,
+    // dcBlock only fades its output in, so at BIAS 0 the wet signal stays in phase with
+    // the dry one and turning BIAS up never starts the filter from a cold state.
+    struct DCBlock
+    {
+        static constexpr double cutoff = 10.0;
+
+        void prepare (double sampleRate)
+        {
+            coeff = std::exp (-2.0 * 3.14159265358979323846 * cutoff / sampleRate);
+            reset();
+        }
+
+        void reset()
+        {
+            for (size_t k = 0; k < 2; ++k)
+                x1[k] = y1[k] = 0.0;
+        }
+
+        template <size_t n>
+        inline void process (Frame<n>& f, const ShaperGains& g, int i)
+        {
+            for (size_t k = 0; k < n; ++k)
+            {
+                const double x = f.lane[k];
+                const auto y = x - x1[k] + coeff * y1[k];
+                x1[k] = x;
+                y1[k] = y;
+                f.lane[k] = (float) (x + (y - x) * g.dcBlock[i]);
+            }
+        }
+
+        double coeff = 0.0;
+        double x1[2] = {};
+        double y1[2] = {};
+    };
+
+    struct Mix
+    {
+        void prepare (double) {}
+        void reset() {}
+
+        template <size_t n>
+        inline void process (Frame<n>& f, const ShaperGains& g, int i)
+        {
+            for (size_t k = 0; k < n; ++k)
+                f.lane[k] = f.dry[k] + (f.lane[k] - f.dry[k]) * g.mix[i];
+        }
+    };
+
+    struct OutputGain
+    {
+        void prepare (double) {}
+        void reset() {}
+
+        template <size_t n>
+        inline void process (Frame<n>& f, const ShaperGains& g, int i)
+        {
+            for (size_t k = 0; k < n; ++k)
+                f.lane[k] *= g.output[i];
+        }
+    };
+}
+
+//==============================================================================
+// Compile time composition of stages. Chain<A, B, C> runs A, B then C on each frame
+// inside one loop, adding a stage never adds another pass over the buffer.
+template <typename... Stages>
+struct Chain;
+
+template <>
+struct Chain<>
+{
+    void prepare (double) {}
+    void reset() {}
+
+    template <size_t n>
+    inline void process (Frame<n>&, const ShaperGains&, int) {}
+};
+
+template <typename First, typename... Rest>
+struct Chain<First, Rest...>
+{
+    void prepare (double sampleRate)
+    {
+        stage.prepare (sampleRate);
+        rest.prepare (sampleRate);
+    }
+
+    void reset()
+    {
+        stage.reset();
+        rest.reset();
+    }
+
+    template <size_t n>
+    inline void process (Frame<n>& f, const ShaperGains& g, int i)
+    {
+        stage.process (f, g, i);
+        rest.process (f, g, i);
+    }
+
+    // the fused loop: load a frame from every channel, run all stages, store it back
+    template <size_t n>
+    void run (float* const* channels, const ShaperGains& g, int numSamples)
+    {
+        for (int i = 0; i < numSamples; ++i)
+        {
+            Frame<n> f;
+            for (size_t k = 0; k < n; ++k)
+                f.lane[k] = f.dry[k] = channels[k][i];
+
+            process (f, g, i);
+
+            for (size_t k = 0; k < n; ++k)
+                channels[k][i] = f.lane[k];
+        }
+    }
+
+    First stage;
+    Chain<Rest...> rest;
+};
@@ -0,0 +1,522 @@
+// Accuracy and throughput of the clipper kernels, at every common sample rate.
+//
+// Baseline is what the original processBlock did: INPUT, one std::atan per sample, a
+// linear dry/wet blend and OUTPUT, with no bias and no DC blocker. With BIAS at 0 the
+// L/R arctan path has to match it, so the plain mode still sounds like it always did.
+//
+// Reference mirrors the current chain (BIAS, the DC blocker and its fade, M/S, linked and
+// the diode) as a plain scalar version in double precision. Every path the plugin runs is
+// compared against it, so a faster kernel that changes the sound fails here instead of
+// in a mix.
+
+#include "Shaper.h"
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+#if defined (__SSE__) || defined (_M_X64)
+ #include <xmmintrin.h>
+#endif
+
+namespace
+{
+    constexpr double sampleRates[] = { 44100.0, 48000.0, 96000.0, 192000.0 };
+    constexpr int blockSize = 512;
+    constexpr double seconds = 2.0;
+    constexpr double pi = 3.14159265358979323846;
+
+    int failures = 0;
+
+    void expect (bool condition, const std::string& what)
+    {
+        if (! condition)
+        {
+            std::printf ("FAIL: %s\n", what.c_str());
+            ++failures;
+        }
+    }
+
+    double decibelsToGain (double dB) { return std::pow (10.0, dB / 20.0); }
+
+    //==============================================================================
+    // Parameter values as the processor sees them after the smoothers, one per sample.
+    // Decibel parameters are already converted to linear gains.
+    struct Settings
+    {
+        std::vector<float> input, drive, side, bias, dcBlock, mix, output;
+
+        Settings (int numSamples, double inputDB, double driveDB, double sideDB, double biasAmount, double mixAmount, double outputDB)
+        {
+            for (auto* v : { &input, &drive, &side, &bias, &dcBlock, &mix, &output })
+                v->resize ((size_t) numSamples);
+
+            std::fill (input.begin(), input.end(), (float) decibelsToGain (inputDB));
+            std::fill (drive.begin(), drive.end(), (float) decibelsToGain (driveDB));
+            std::fill (side.begin(), side.end(), (float) decibelsToGain (sideDB));
+            std::fill (bias.begin(), bias.end(), (float) biasAmount);
+            std::fill (dcBlock.begin(), dcBlock.end(), biasAmount != 0.0 ? 1.0f : 0.0f);
+            std::fill (mix.begin(), mix.end(), (float) mixAmount);
+            std::fill (output.begin(), output.end(), (float) decibelsToGain (outputDB));
+        }
+
+        // every parameter swept across its full range, out of step with each other;
+        // without bias, BIAS and the DC blocker stay at 0 like they do in the processor
+        static Settings sweep (int numSamples, bool withBias)
+        {
+            Settings s (numSamples, 0, 0, 0, 0, 1, 0);
+            for (int i = 0; i < numSamples; ++i)
+            {
+                const auto t = (double) i / numSamples;
+                const auto wave = [t] (double cycles) { return 0.5 - 0.5 * std::cos (2.0 * pi * cycles * t); };
+                s.input[(size_t) i]  = (float) decibelsToGain (-30.0 + 42.0 * wave (3.0));
+                s.drive[(size_t) i]  = (float) decibelsToGain (15.0 * wave (5.0));
+                s.side[(size_t) i]   = (float) decibelsToGain (15.0 * wave (7.0));
+                s.bias[(size_t) i]   = withBias ? (float) (0.5 * wave (2.0)) : 0.0f;
+                s.dcBlock[(size_t) i] = withBias ? (float) wave (6.0) : 0.0f;
+                s.mix[(size_t) i]    = (float) wave (4.0);
+                s.output[(size_t) i] = (float) decibelsToGain (-30.0 + 42.0 * wave (1.0));
+            }
+            return s;
+        }
+
+        ShaperGains gains (int start, const DiodeTable* table) const
+        {
+            return { input.data() + start, drive.data() + start, side.data() + start,
+                     bias.data() + start, dcBlock.data() + start, mix.data() + start, output.data() + start, table };
+        }
+    };
+
+    struct Signal
+    {
+        std::string name;
+        std::vector<float> left, right;
+    };
+
+    std::string describe (const char* kind, float amplitude)
+    {
+        char text[64];
+        std::snprintf (text, sizeof (text), "%s %g", kind, (double) amplitude);
+        return text;
+    }
+
+    // log sweep 20 Hz - 20 kHz, the right channel lags so M/S and linked see a real side signal
+    Signal sweptSine (double sampleRate, float amplitude)
+    {
+        const auto numSamples = (int) (seconds * sampleRate);
+        Signal s { describe ("swept sine", amplitude), std::vector<float> ((size_t) numSamples), std::vector<float> ((size_t) numSamples) };
+        const auto duration = numSamples / sampleRate;
+        const auto k = std::log (20000.0 / 20.0);
+
+        for (int i = 0; i < numSamples; ++i)
+        {
+            const auto t = i / sampleRate;
+            const auto phase = 2.0 * pi * 20.0 * duration / k * (std::exp (t / duration * k) - 1.0);
+            s.left[(size_t) i]  = amplitude * (float) std::sin (phase);
+            s.right[(size_t) i] = amplitude * (float) std::sin (phase - 0.7);
+        }
+        return s;
+    }
+
+    Signal noise (double sampleRate, float amplitude)
+    {
+        const auto numSamples = (int) (seconds * sampleRate);
+        Signal s { describe ("noise", amplitude), std::vector<float> ((size_t) numSamples), std::vector<float> ((size_t) numSamples) };
+        std::mt19937 random (322);
+        std::uniform_real_distribution<float> dist (-amplitude, amplitude);
+
+        for (int i = 0; i < numSamples; ++i)
+        {
+            s.left[(size_t) i] = dist (random);
+            s.right[(size_t) i] = dist (random);
+        }
+        return s;
+    }
+
+    // a full scale burst into silence, the filter states have to decay without going subnormal
+    Signal burst (double sampleRate)
+    {
+        auto s = noise (sampleRate, 1.0f);
+        s.name = "burst into silence";
+        const auto silence = (std::ptrdiff_t) s.left.size() / 8;
+        std::fill (s.left.begin() + silence, s.left.end(), 0.0f);
+        std::fill (s.right.begin() + silence, s.right.end(), 0.0f);
+        return s;
+    }
+
+    double arctan (double x) { return 2.0 / pi * std::atan (x); }
+
+    //==============================================================================
+    // The original processBlock, per channel: no bias, no DC blocker, no stereo modes.
+    double baseline (double x, const ShaperGains& g, int i)
+    {
+        const auto input = x * g.input[i];
+        const auto softClip = arctan (input * g.drive[i]);
+        const auto blend = input * (1.0 - g.mix[i]) + softClip * g.mix[i];
+        return blend * g.output[i];
+    }
+
+    //==============================================================================
+    // The reference: scalar, one sample at a time, double precision, std::atan.
+    struct Reference
+    {
+        explicit Reference (double rate)
+            : sampleRate (rate), dcCoeff (std::exp (-2.0 * pi * Stage::DCBlock::cutoff / rate)),
+              releaseCoeff (std::exp (-1.0 / (Stage::LinkedArctan::release * rate))) {}
+
+        double sampleRate;
+        double dcCoeff;
+        double releaseCoeff;
+        double envelope = 0;
+        double x1[2] = {}, y1[2] = {};
+        double v[2] = {}, current[2] = {};
+
+        double dcBlock (int k, double x, double amount)
+        {
+            const auto y = x - x1[k] + dcCoeff * y1[k];
+            x1[k] = x;
+            y1[k] = y;
+            return x + (y - x) * amount;
+        }
+
+        // the diode ODE solved to convergence, bisection keeps Newton inside the bracket
+        double diode (int k, double x, double drive)
+        {
+            const double r = DiodeTable::resistance, is = DiodeTable::saturationCurrent, vt = DiodeTable::thermalVoltage;
+            const auto h = 0.5 / (sampleRate * DiodeTable::capacitance);
+            const auto vin = x * drive * (2.0 / pi) * Stage::Diode<false>::clipVoltage;
+            const auto rhs = v[k] + h * (current[k] + vin / r);
+            const auto f = [&] (double u) { return u + h * (u / r + 2.0 * is * std::sinh (u / vt)) - rhs; };
+
+            double low = -4.0, high = 4.0, u = v[k];
+            for (int it = 0; it < 200; ++it)
+            {
+                const auto residual = f (u);
+                if (residual < 0) low = u; else high = u;
+
+                const auto step = residual / (1.0 + h * (1.0 / r + 2.0 * is / vt * std::cosh (u / vt)));
+                const auto next = u - step;
+                u = next >= low && next <= high ? next : 0.5 * (low + high);
+
+                if (std::abs (step) < 1.0e-13)
+                    break;
+            }
+
+            current[k] = vin / r + (u - rhs) / h;
+            v[k] = u;
+            return u / Stage::Diode<false>::clipVoltage;
+        }
+
+        void process (StereoMode mode, ClipperType clipper, double& left, double& right, const ShaperGains& g, int i)
+        {
+            double lane[2] = { left * g.input[i], right * g.input[i] };
+
+            if (mode == StereoMode::midSide)
+            {
+                const auto mid = (lane[0] + lane[1]) * 0.5, side = (lane[0] - lane[1]) * 0.5;
+                lane[0] = mid;
+                lane[1] = side;
+            }
+
+            const double dry[2] = { lane[0], lane[1] };
+            const double drive[2] = { g.drive[i], mode == StereoMode::midSide ? g.sideDrive[i] : g.drive[i] };
+
+            for (int k = 0; k < 2; ++k)
+                lane[k] += g.bias[i];
+
+            if (mode == StereoMode::linked && clipper == ClipperType::arctan)
+            {
+                envelope = std::max (std::max (std::abs (lane[0]), std::abs (lane[1])), envelope * releaseCoeff);
+                const auto level = envelope * g.drive[i];
+                const auto gain = level > 1.0e-9 ? arctan (level) / level * g.drive[i] : 2.0 / pi * g.drive[i];
+                lane[0] *= gain;
+                lane[1] *= gain;
+            }
+            else
+            {
+                for (int k = 0; k < 2; ++k)
+                    lane[k] = clipper == ClipperType::diode ? diode (k, lane[k], drive[k]) : arctan (lane[k] * drive[k]);
+            }
+
+            for (int k = 0; k < 2; ++k)
+                lane[k] = (dry[k] + (dcBlock (k, lane[k], g.dcBlock[i]) - dry[k]) * g.mix[i]) * g.output[i];
+
+            if (mode == StereoMode::midSide)
+            {
+                left = lane[0] + lane[1];
+                right = lane[0] - lane[1];
+            }
+            else
+            {
+                left = lane[0];
+                right = lane[1];
+            }
+        }
+    };
+
+    //==============================================================================
+    struct Variant
+    {
+        const char* name;
+        StereoMode mode;
+        ClipperType clipper;
+        double maxError, rmsError;
+    };
+
+    // The arctan chains only differ from the reference by float rounding. The diode is a
+    // table lookup plus one Newton-Raphson step against a fully converged solve.
+    const Variant variants[] =
+    {
+        { "arctan L/R",    StereoMode::leftRight, ClipperType::arctan, 1.0e-4, 1.0e-5 },
+        { "arctan M/S",    StereoMode::midSide,   ClipperType::arctan, 1.0e-4, 1.0e-5 },
+        { "arctan linked", StereoMode::linked,    ClipperType::arctan, 1.0e-4, 1.0e-5 },
+        { "diode L/R",     StereoMode::leftRight, ClipperType::diode,  1.0e-3, 1.0e-4 },
+        { "diode M/S",     StereoMode::midSide,   ClipperType::diode,  1.0e-3, 1.0e-4 },
+    };
+
+    struct Result
+    {
+        double maxError = 0, sumSquares = 0, peak = 0;
+        int nonFinite = 0, subnormal = 0;
+    };
+
+    void runFast (const Variant& variant, const Signal& signal, const Settings& settings, const DiodeTable& table,
+                  std::vector<float>& left, std::vector<float>& right)
+    {
+        left = signal.left;
+        right = signal.right;
+        const auto numSamples = (int) left.size();
+
+        Shaper shaper;
+        shaper.prepare (table.getSampleRate(), blockSize);
+
+        // the processor hands the shaper chunks of at most one block
+        for (int start = 0; start < numSamples; start += blockSize)
+        {
+            const auto n = std::min (blockSize, numSamples - start);
+            shaper.process (variant.mode, variant.clipper, left.data() + start, right.data() + start, settings.gains (start, &table), n);
+        }
+    }
+
+    // the fast path against the reference, or against the baseline of the original plugin
+    Result compare (const Variant& variant, const Signal& signal, const Settings& settings, const DiodeTable& table,
+                    bool useBaseline)
+    {
+        std::vector<float> left, right;
+        runFast (variant, signal, settings, table, left, right);
+
+        Result result;
+        Reference reference (table.getSampleRate());
+        const auto gains = settings.gains (0, &table);
+
+        for (int i = 0; i < (int) left.size(); ++i)
+        {
+            double l = signal.left[(size_t) i], r = signal.right[(size_t) i];
+            if (useBaseline)
+            {
+                l = baseline (l, gains, i);
+                r = baseline (r, gains, i);
+            }
+            else
+            {
+                reference.process (variant.mode, variant.clipper, l, r, gains, i);
+            }
+
+            for (const auto& [fast, exact] : { std::pair<float, double> { left[(size_t) i], l }, { right[(size_t) i], r } })
+            {
+                if (! std::isfinite (fast))
+                {
+                    ++result.nonFinite;
+                    continue;
+                }
+                if (std::fpclassify (fast) == FP_SUBNORMAL)
+                    ++result.subnormal;
+
+                result.peak = std::max (result.peak, (double) std::abs (fast));
+
+                const auto error = std::abs ((double) fast - exact);
+                result.maxError = std::max (result.maxError, error);
+                result.sumSquares += error * error;
+            }
+        }
+        return result;
+    }
+
+    // Linked: a loud 50 Hz on the left and a quiet 1 kHz on the right. The right lane only
+    // sees the shared gain, so its gain spread over the second half (in dB) is how much the
+    // left lane modulates it. A gain that follows every sample swings it by several dB.
+    double linkedGainSpreadDB (double sampleRate)
+    {
+        const auto numSamples = (int) (seconds * sampleRate);
+        const DiodeTable table (sampleRate);
+        const Settings settings (numSamples, 0, 6, 6, 0, 1, 0);
+        const Variant linked { "arctan linked", StereoMode::linked, ClipperType::arctan, 0, 0 };
+
+        Signal signal { "linked", std::vector<float> ((size_t) numSamples), std::vector<float> ((size_t) numSamples) };
+        for (int i = 0; i < numSamples; ++i)
+        {
+            signal.left[(size_t) i]  = (float) std::sin (2.0 * pi * 50.0 * i / sampleRate);
+            signal.right[(size_t) i] = 0.01f * (float) std::sin (2.0 * pi * 1000.0 * i / sampleRate);
+        }
+
+        std::vector<float> left, right;
+        runFast (linked, signal, settings, table, left, right);
+
+        auto lowest = 1.0e30, highest = 0.0;
+        for (int i = numSamples / 2; i < numSamples; ++i)
+        {
+            if (std::abs (signal.right[(size_t) i]) < 0.005f)
+                continue;
+
+            const auto gain = (double) right[(size_t) i] / signal.right[(size_t) i];
+            lowest = std::min (lowest, gain);
+            highest = std::max (highest, gain);
+        }
+        return 20.0 * std::log10 (highest / lowest);
+    }
+
+    double nanosecondsPerFrame (const Variant& variant, const Signal& signal, const Settings& settings, const DiodeTable& table, bool useReference)
+    {
+        std::vector<float> left, right;
+        const auto numSamples = (int) signal.left.size();
+        const auto begin = std::chrono::steady_clock::now();
+
+        if (useReference)
+        {
+            Reference reference (table.getSampleRate());
+            double sink = 0;
+            for (int i = 0; i < numSamples; ++i)
+            {
+                double l = signal.left[(size_t) i], r = signal.right[(size_t) i];
+                reference.process (variant.mode, variant.clipper, l, r, settings.gains (0, &table), i);
+                sink += l + r;
+            }
+            // keep the optimiser from dropping the loop
+            if (sink == 12345.678)
+                std::printf (" ");
+        }
+        else
+        {
+            runFast (variant, signal, settings, table, left, right);
+        }
+
+        const std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - begin;
+        return elapsed.count() / numSamples;
+    }
+}
+
+//==============================================================================
+int main()
+{
+   #if defined (__SSE__) || defined (_M_X64)
+    // same floating point mode the processor runs in (juce::ScopedNoDenormals)
+    _mm_setcsr (_mm_getcsr() | 0x8040);
+   #endif
+
+    struct Case
+    {
+        Signal signal;
+        Settings settings;
+        bool checkError;
+    };
+
+    const auto maxPeak = 2.0 * 1.5 * decibelsToGain (12.0);
+
+    for (const auto sampleRate : sampleRates)
+    {
+        const DiodeTable table (sampleRate);
+        const auto numSamples = (int) (seconds * sampleRate);
+        std::printf ("%.0f Hz\n", sampleRate);
+
+        // BIAS 0 and the plain L/R arctan, the sound of the original plugin
+        const Case baselineCases[] =
+        {
+            { sweptSine (sampleRate, 1.0f), Settings (numSamples, 0, 6, 6, 0, 1, 0),   true },
+            { sweptSine (sampleRate, 1.0f), Settings (numSamples, 0, 6, 6, 0, 0.5, 0), true },
+            { noise (sampleRate, 1.0f),     Settings (numSamples, 0, 6, 6, 0, 0.5, 0), true },
+            { sweptSine (sampleRate, 1.0f), Settings::sweep (numSamples, false),       true },
+        };
+
+        for (const auto& c : baselineCases)
+        {
+            const auto& variant = variants[0];
+            const auto result = compare (variant, c.signal, c.settings, table, true);
+            const auto rms = std::sqrt (result.sumSquares / (2.0 * numSamples));
+            const auto label = std::to_string ((int) sampleRate) + " Hz, baseline, " + c.signal.name;
+
+            std::printf ("%-16s %-20s max %-10.3g rms %-10.3g peak %.3g\n", "baseline", c.signal.name.c_str(), result.maxError, rms, result.peak);
+
+            expect (result.nonFinite == 0, label + ": " + std::to_string (result.nonFinite) + " samples are NaN/Inf");
+            expect (result.maxError <= variant.maxError, label + ": max error above bound");
+            expect (rms <= variant.rmsError, label + ": rms error above bound");
+        }
+
+        // The error bounds hold over the whole parameter range. Far beyond 0 dBFS into maximum
+        // INPUT and DRIVE the output has to stay finite, free of subnormals and still clipped:
+        // a fully wet clipper is within +-1.5 per lane before OUTPUT, twice that after M/S decode.
+        const Case cases[] =
+        {
+            { sweptSine (sampleRate, 1.0f),   Settings (numSamples, 0, 6, 6, 0.1, 1, 0),     true },
+            { noise (sampleRate, 1.0f),       Settings (numSamples, 0, 6, 6, 0.1, 1, 0),     true },
+            { sweptSine (sampleRate, 1.0f),   Settings (numSamples, 0, 6, 6, 0.0, 0.5, 0),   true },
+            { sweptSine (sampleRate, 1.0f),   Settings::sweep (numSamples, true),            true },
+            { noise (sampleRate, 1.0f),       Settings::sweep (numSamples, true),            true },
+            { sweptSine (sampleRate, 1.0f),   Settings (numSamples, 12, 15, 15, 0.5, 1, 12), true },
+            { noise (sampleRate, 1.0e-35f),   Settings (numSamples, 12, 15, 15, 0.0, 1, 12), true },
+            { burst (sampleRate),             Settings (numSamples, 12, 15, 15, 0.5, 1, 12), true },
+            { sweptSine (sampleRate, 1.0e3f), Settings (numSamples, 12, 15, 15, 0.5, 1, 12), false },
+            { noise (sampleRate, 1.0e6f),     Settings (numSamples, 12, 15, 15, 0.5, 1, 12), false },
+        };
+
+        for (const auto& variant : variants)
+        {
+            for (const auto& c : cases)
+            {
+                const auto result = compare (variant, c.signal, c.settings, table, false);
+                const auto rms = std::sqrt (result.sumSquares / (2.0 * numSamples));
+                const auto label = std::to_string ((int) sampleRate) + " Hz, " + variant.name + ", " + c.signal.name;
+
+                std::printf ("%-16s %-20s max %-10.3g rms %-10.3g peak %.3g\n", variant.name, c.signal.name.c_str(), result.maxError, rms, result.peak);
+
+                expect (result.nonFinite == 0, label + ": " + std::to_string (result.nonFinite) + " samples are NaN/Inf");
+                expect (result.subnormal == 0, label + ": " + std::to_string (result.subnormal) + " samples are subnormal");
+
+                if (c.checkError)
+                {
+                    expect (result.maxError <= variant.maxError, label + ": max error above bound");
+                    expect (rms <= variant.rmsError, label + ": rms error above bound");
+                }
+                else
+                {
+                    expect (result.peak <= maxPeak, label + ": output is no longer clipped");
+                }
+            }
+        }
+        std::printf ("\n");
+    }
+
+    for (const auto sampleRate : sampleRates)
+    {
+        const auto spread = linkedGainSpreadDB (sampleRate);
+        std::printf ("linked gain spread at %.0f Hz: %.2f dB\n", sampleRate, spread);
+        expect (spread <= 1.0, std::to_string ((int) sampleRate) + " Hz, linked: the quiet lane is modulated by the loud one");
+    }
+
+    // throughput of each variant next to its reference, noise at the default settings
+    std::printf ("%-16s %14s %14s\n", "ns/stereo frame", "reference", "fast");
+    const auto sampleRate = 48000.0;
+    const auto numSamples = (int) (seconds * sampleRate);
+    const DiodeTable table (sampleRate);
+    const auto signal = noise (sampleRate, 1.0f);
+    const Settings settings (numSamples, 0, 6, 6, 0.1, 1, 0);
+
+    for (const auto& variant : variants)
+        std::printf ("%-16s %14.1f %14.1f\n", variant.name,
+                     nanosecondsPerFrame (variant, signal, settings, table, true),
+                     nanosecondsPerFrame (variant, signal, settings, table, false));
+
+    std::printf ("\n%s\n", failures == 0 ? "All kernel tests passed" : "Kernel tests FAILED");
+    return failures == 0 ? 0 : 1;
+}
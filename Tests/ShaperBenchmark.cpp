@@ -0,0 +1,121 @@
+// Per-instance cost of every Shaper path, the diode next to the arctan it replaces.
+// One instance renders a few seconds of stereo noise at the usual rates and block sizes;
+// the best of several runs is reported as ns per stereo frame, the share of one core it
+// takes in realtime, and how many instances fit on a core. The diode table is built once
+// per sample rate in prepareToPlay and shared, its build time is listed separately.
+//
+//     ShaperBenchmark [seconds of audio per run, default 4]
+
+#include "Shaper.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    struct Path
+    {
+        const char* name;
+        StereoMode mode;
+        ClipperType clipper;
+        bool stereo;
+    };
+
+    const Path paths[] =
+    {
+        { "arctan mono",   StereoMode::leftRight, ClipperType::arctan, false },
+        { "arctan L/R",    StereoMode::leftRight, ClipperType::arctan, true },
+        { "arctan M/S",    StereoMode::midSide,   ClipperType::arctan, true },
+        { "arctan linked", StereoMode::linked,    ClipperType::arctan, true },
+        { "diode mono",    StereoMode::leftRight, ClipperType::diode,  false },
+        { "diode L/R",     StereoMode::leftRight, ClipperType::diode,  true },
+        { "diode M/S",     StereoMode::midSide,   ClipperType::diode,  true },
+    };
+
+    // best of a few runs, in ns per frame
+    double measure (const Path& path, double sampleRate, int blockSize, double seconds)
+    {
+        const auto numSamples = (int) (sampleRate * seconds);
+        const DiodeTable table (sampleRate);
+
+        // the same settings for the whole run, what the processor hands over between automation
+        std::vector<float> unity ((size_t) blockSize, 1.0f), drive ((size_t) blockSize, 2.8f),
+                           bias ((size_t) blockSize, 0.1f);
+        const ShaperGains gains { unity.data(), drive.data(), drive.data(), bias.data(), unity.data(), unity.data(), unity.data(), &table };
+
+        std::vector<float> source ((size_t) numSamples * 2);
+        std::mt19937 random (322);
+        std::uniform_real_distribution<float> dist (-0.5f, 0.5f);
+        for (auto& sample : source)
+            sample = dist (random);
+
+        std::vector<float> left ((size_t) blockSize), right ((size_t) blockSize);
+        auto best = 1.0e30;
+
+        for (int run = 0; run < 5; ++run)
+        {
+            Shaper shaper;
+            shaper.prepare (sampleRate, blockSize);
+            const auto begin = Clock::now();
+
+            for (int start = 0; start + blockSize <= numSamples; start += blockSize)
+            {
+                std::copy (source.begin() + start, source.begin() + start + blockSize, left.begin());
+                std::copy (source.begin() + numSamples + start, source.begin() + numSamples + start + blockSize, right.begin());
+                shaper.process (path.mode, path.clipper, left.data(), path.stereo ? right.data() : nullptr, gains, blockSize);
+            }
+
+            const std::chrono::duration<double, std::nano> elapsed = Clock::now() - begin;
+            best = std::min (best, elapsed.count() / numSamples);
+        }
+        return best;
+    }
+}
+
+//==============================================================================
+int main (int argc, char* argv[])
+{
+    const auto seconds = argc > 1 ? std::max (0.1, std::atof (argv[1])) : 4.0;
+
+    std::printf ("%-14s %8s %6s %14s %10s %12s %12s\n", "path", "rate", "block", "ns/frame", "core %",
+                 "per core", "vs arctan");
+
+    for (const auto sampleRate : { 44100.0, 48000.0, 96000.0, 192000.0 })
+    {
+        for (const auto blockSize : { 64, 512 })
+        {
+            double arctanCost[2] = {};
+
+            for (const auto& path : paths)
+            {
+                const auto cost = measure (path, sampleRate, blockSize, seconds);
+                const auto coreShare = cost * sampleRate * 1.0e-9;
+
+                // every path is compared to the plain arctan with the same channel count
+                auto& reference = arctanCost[path.stereo ? 1 : 0];
+                if (path.clipper == ClipperType::arctan && path.mode == StereoMode::leftRight)
+                    reference = cost;
+
+                std::printf ("%-14s %8.0f %6d %14.1f %10.3f %12.0f %11.2fx\n", path.name, sampleRate, blockSize, cost,
+                             coreShare * 100.0, 1.0 / coreShare, cost / reference);
+            }
+            std::printf ("\n");
+        }
+    }
+
+    // prepareToPlay cost, paid once per sample rate for all instances together
+    for (const auto sampleRate : { 44100.0, 48000.0, 96000.0, 192000.0 })
+    {
+        const auto begin = Clock::now();
+        const DiodeTable table (sampleRate);
+        const std::chrono::duration<double, std::milli> elapsed = Clock::now() - begin;
+        std::printf ("diode table at %.0f Hz: %.2f ms (h = %g)\n", sampleRate, elapsed.count(), (double) table.getH());
+    }
+
+    return 0;
+}
@@ -0,0 +1,261 @@
+// Many instances of the real processor driven from a juce::ThreadPool, the way a host
+// spreads a big session over its worker threads. Every period the workers pull instances
+// off a shared queue until all of them have rendered one block, while the main thread
+// automates parameters like a host or an open editor would. For each block size and
+// thread count it reports throughput, deadline misses and the cost of one instance-block.
+// If that cost grows with the thread count, instances are fighting over shared state
+// (false sharing, locks, listener callbacks) instead of running independently.
+//
+//     StressTest [--instances 200] [--seconds 2] [--rate 48000]
+
+#include <JuceHeader.h>
+#include "PluginProcessor.h"
+
+#include <cmath>
+#include <cstdio>
+
+namespace
+{
+    // one instance and what its block costs, aligned so workers never share a cache line
+    struct alignas (64) Instance
+    {
+        Dist0322AudioProcessor processor;
+        juce::AudioBuffer<float> buffer;
+        juce::MidiBuffer midi;
+        juce::int64 busyTicks = 0;
+        juce::int64 worstTicks = 0;
+        bool finite = true;
+    };
+
+    void setParameter (Dist0322AudioProcessor& processor, const juce::String& id, float value)
+    {
+        auto* parameter = processor.apvts.getParameter (id);
+        parameter->setValueNotifyingHost (parameter->convertTo0to1 (value));
+    }
+
+    // every sample of the block, a NaN that only lasts a few blocks must not slip through
+    bool isFinite (const juce::AudioBuffer<float>& buffer)
+    {
+        for (int channel = 0; channel < buffer.getNumChannels(); ++channel)
+        {
+            const auto* data = buffer.getReadPointer (channel);
+            for (int i = 0; i < buffer.getNumSamples(); ++i)
+                if (! std::isfinite (data[i]))
+                    return false;
+        }
+        return true;
+    }
+
+    struct Period
+    {
+        std::vector<std::unique_ptr<Instance>>& instances;
+        const juce::AudioBuffer<float>& source;
+        int sourcePosition = 0;
+        std::atomic<int> next { 0 };
+        std::atomic<int> workersLeft { 0 };
+        juce::WaitableEvent finished;
+    };
+
+    // One per pool thread: keeps taking instances until the period is rendered.
+    class Worker : public juce::ThreadPoolJob
+    {
+    public:
+        explicit Worker (Period& p) : juce::ThreadPoolJob ("Worker"), period (p) {}
+
+        JobStatus runJob() override
+        {
+            const auto numInstances = (int) period.instances.size();
+
+            for (auto index = period.next.fetch_add (1); index < numInstances; index = period.next.fetch_add (1))
+            {
+                auto& instance = *period.instances[(size_t) index];
+                const auto start = juce::Time::getHighResolutionTicks();
+
+                // the host copies the input in, then calls the plugin
+                for (int channel = 0; channel < instance.buffer.getNumChannels(); ++channel)
+                    instance.buffer.copyFrom (channel, 0, period.source, channel, period.sourcePosition, instance.buffer.getNumSamples());
+                instance.processor.processBlock (instance.buffer, instance.midi);
+
+                const auto ticks = juce::Time::getHighResolutionTicks() - start;
+                instance.busyTicks += ticks;
+                instance.worstTicks = juce::jmax (instance.worstTicks, ticks);
+
+                // checked outside the timed part, the scan is not the plugin's cost
+                if (instance.finite && ! isFinite (instance.buffer))
+                    instance.finite = false;
+            }
+
+            if (period.workersLeft.fetch_sub (1) == 1)
+                period.finished.signal();
+
+            return jobHasFinished;
+        }
+
+    private:
+        Period& period;
+    };
+
+    struct Result
+    {
+        double secondsPerInstanceBlock = 0;
+        double worstInstanceBlock = 0;
+        double realtimeFactor = 0;
+        double worstPeriodLoad = 0;
+        int misses = 0;
+        int periods = 0;
+    };
+
+    Result run (std::vector<std::unique_ptr<Instance>>& instances, const juce::AudioBuffer<float>& source,
+                int numThreads, int blockSize, double sampleRate, double seconds)
+    {
+        for (auto& instance : instances)
+        {
+            instance->processor.setPlayConfigDetails (2, 2, sampleRate, blockSize);
+            instance->processor.prepareToPlay (sampleRate, blockSize);
+            instance->buffer.setSize (2, blockSize);
+            instance->busyTicks = instance->worstTicks = 0;
+        }
+
+        juce::ThreadPool pool (numThreads);
+        std::vector<std::unique_ptr<Worker>> workers;
+        Period period { instances, source };
+
+        for (int i = 0; i < numThreads; ++i)
+            workers.push_back (std::make_unique<Worker> (period));
+
+        const auto budget = blockSize / sampleRate;
+        const auto numPeriods = juce::jmax (1, (int) (seconds * sampleRate / blockSize));
+        const auto begin = juce::Time::getHighResolutionTicks();
+        Result result;
+
+        for (int p = 0; p < numPeriods; ++p)
+        {
+            period.sourcePosition = (p * blockSize) % (source.getNumSamples() - blockSize);
+            period.next = 0;
+            period.workersLeft = numThreads;
+            period.finished.reset();
+
+            const auto periodStart = juce::Time::getHighResolutionTicks();
+            for (auto& worker : workers)
+                pool.addJob (worker.get(), false);
+
+            // automation from the main thread while the workers render, a few instances
+            // per period, so any state the processor shares across threads gets contended
+            for (int k = 0; k < 4; ++k)
+            {
+                auto& processor = instances[(size_t) ((p * 4 + k) % (int) instances.size())]->processor;
+                setParameter (processor, "DRIVE", (float) ((p + k) % 16));
+                setParameter (processor, "MIX", (float) ((p * 7 + k) % 101));
+            }
+
+            period.finished.wait();
+            const auto load = juce::Time::highResolutionTicksToSeconds (juce::Time::getHighResolutionTicks() - periodStart) / budget;
+
+            // the job is only back in our hands once the pool has let go of it
+            for (auto& worker : workers)
+                pool.waitForJobToFinish (worker.get(), -1);
+
+            result.worstPeriodLoad = juce::jmax (result.worstPeriodLoad, load);
+            if (load > 1.0)
+                ++result.misses;
+        }
+
+        const auto elapsed = juce::Time::highResolutionTicksToSeconds (juce::Time::getHighResolutionTicks() - begin);
+        juce::int64 busy = 0, worst = 0;
+
+        for (auto& instance : instances)
+        {
+            busy += instance->busyTicks;
+            worst = juce::jmax (worst, instance->worstTicks);
+            instance->processor.releaseResources();
+        }
+
+        result.periods = numPeriods;
+        result.secondsPerInstanceBlock = juce::Time::highResolutionTicksToSeconds (busy) / ((double) numPeriods * (double) instances.size());
+        result.worstInstanceBlock = juce::Time::highResolutionTicksToSeconds (worst);
+        result.realtimeFactor = numPeriods * budget / elapsed;
+        return result;
+    }
+}
+
+//==============================================================================
+int main (int argc, char* argv[])
+{
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+    const juce::ArgumentList args (argc, argv);
+
+    const auto numInstances = juce::jmax (1, args.containsOption ("--instances") ? args.getValueForOption ("--instances").getIntValue() : 200);
+    const auto seconds = args.containsOption ("--seconds") ? args.getValueForOption ("--seconds").getDoubleValue() : 2.0;
+    const auto sampleRate = args.containsOption ("--rate") ? args.getValueForOption ("--rate").getDoubleValue() : 48000.0;
+    const auto numCpus = juce::SystemStats::getNumCpus();
+    const auto numPhysicalCpus = juce::SystemStats::getNumPhysicalCpus();
+
+    // a mixed session: every stereo mode and clipper, some with auto gain
+    std::vector<std::unique_ptr<Instance>> instances;
+    for (int i = 0; i < numInstances; ++i)
+    {
+        instances.push_back (std::make_unique<Instance>());
+        auto& processor = instances.back()->processor;
+        setParameter (processor, "DRIVE", 9.0f);
+        setParameter (processor, "BIAS", 20.0f);
+        setParameter (processor, "MIX", 100.0f);
+        setParameter (processor, "STEREO", (float) (i % 3));
+        setParameter (processor, "CLIPPER", (float) (i % 2));
+        setParameter (processor, "AUTOGAIN", i % 4 == 0 ? 1.0f : 0.0f);
+    }
+
+    // one second of noise that every instance reads from, read only so it shares nothing
+    juce::AudioBuffer<float> source (2, (int) sampleRate);
+    juce::Random random (322);
+    for (int channel = 0; channel < 2; ++channel)
+        for (int i = 0; i < source.getNumSamples(); ++i)
+            source.setSample (channel, i, random.nextFloat() - 0.5f);
+
+    std::vector<int> threadCounts;
+    for (int threads = 1; threads < numCpus; threads *= 2)
+        threadCounts.push_back (threads);
+    threadCounts.push_back (numCpus);
+
+    std::printf ("%d instances, %.0f Hz, %.1f s per run, %d cpus (%d physical)\n\n", numInstances, sampleRate, seconds, numCpus, numPhysicalCpus);
+    std::printf ("%6s %8s %12s %14s %10s %12s %14s %14s\n", "block", "threads", "x realtime", "us/inst-block",
+                 "scaling", "misses", "worst period", "worst block us");
+
+    auto allFinite = true;
+    auto contended = false;
+
+    for (const auto blockSize : { 64, 128, 256, 512 })
+    {
+        double singleThreadCost = 0;
+
+        for (const auto threads : threadCounts)
+        {
+            const auto result = run (instances, source, threads, blockSize, sampleRate, seconds);
+
+            if (threads == 1)
+                singleThreadCost = result.secondsPerInstanceBlock;
+
+            // what one instance-block costs compared to running alone; with independent
+            // instances this stays near 1 up to the physical core count
+            const auto inflation = result.secondsPerInstanceBlock / singleThreadCost;
+
+            std::printf ("%6d %8d %12.2f %14.2f %10.2f %5d/%-6d %13.0f%% %14.1f%s\n", blockSize, threads,
+                         result.realtimeFactor, result.secondsPerInstanceBlock * 1.0e6, inflation,
+                         result.misses, result.periods, result.worstPeriodLoad * 100.0, result.worstInstanceBlock * 1.0e6,
+                         threads <= numPhysicalCpus && inflation > 1.25 ? "  <- contention" : "");
+
+            contended = contended || (threads <= numPhysicalCpus && inflation > 1.25);
+        }
+    }
+
+    for (auto& instance : instances)
+        allFinite = allFinite && instance->finite;
+
+    std::printf ("\n");
+    if (contended)
+        std::printf ("Per instance cost grew with the thread count: look for writes to shared state, locks or\n"
+                     "cross-thread callbacks (false sharing between instances, apvts listeners).\n");
+    if (! allFinite)
+        std::printf ("FAIL: an instance produced NaN/Inf\n");
+
+    return allFinite ? 0 : 1;
+}